@@ -2,16 +2,33 @@
 #define ACTUATOR_CONTROL_H
 
 #include "stdint.h"
+#include "stdbool.h"
 
 #define NUM_ACTUATORS           45
 #define MODES_SIZE              1
 
-// Enum of actuator control modes
+/**
+ * Enum of actuator control modes, the values are what the app sends as the first byte of a course state.
+ * 1 is the app's ball return mode, which doesn't change how the course moves. RESET is never sent by the
+ * app for a normal course change, it flattens the whole course in one broadcast and then falls back to STATIC.
+ */
 typedef enum {
-    RESET = 0,
-    STATIC,
+    STATIC = 0,
+    WAVE = 2,           // course generated on the device by the animation engine
+    TSUNAMI = 3,        // course generated on the device by the animation engine
+    RESET = 4,
 } ACMode_e;
 
+// Easing of a timed transition, see AC_update_desired_positions_timed
+typedef enum {
+    EASE_LINEAR = 0,
+    EASE_IN,            // starts slow, arrives at full speed
+    EASE_OUT,           // starts at full speed, arrives slow
+    EASE_IN_OUT,        // slow at both ends (smoothstep)
+
+    NUM_EASINGS
+} ACEasing_e;
+
 /**
  * @brief Initializes the actuator control task
  */
@@ -28,6 +45,21 @@ void AC_run_task(void);
  */
 void AC_update_desired_positions(uint8_t desiredPos[NUM_ACTUATORS]);
 
+/**
+ * @brief Updates the desired positions of the actuators, reaching them after a set time instead of as
+ *        fast as the motion limits allow. Not saved as the course state.
+ * @param desiredPos Array of desired actuator positions
+ * @param durationMs How long the transition takes, it is never made shorter than the motion limits allow
+ * @param easing How the actuators speed up and slow down along the way
+ */
+void AC_update_desired_positions_timed(const uint8_t desiredPos[NUM_ACTUATORS], uint32_t durationMs, ACEasing_e easing);
+
+/**
+ * @brief Whether the course has stopped moving, no transition, reset or animation is running or about to
+ * @return true once settled
+ */
+bool AC_is_settled(void);
+
 /**
  * @brief Updates the actuator control mode
  * @param mode Actuator control mode
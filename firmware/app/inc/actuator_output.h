@@ -0,0 +1,61 @@
+#ifndef ACTUATOR_OUTPUT_H
+#define ACTUATOR_OUTPUT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "pca9685.h"
+
+#define NUM_HW_GROUPS               3
+
+/**
+ * @brief Initializes the PCA9685 boards of every HW group and the frame queue
+ */
+void AO_init(void);
+
+/**
+ * @brief Writes a frame straight to a board from the calling task. Only meant for boot, before the output task runs.
+ * @param hwGroup HW group (board) the frame is for
+ * @param framePos Positions of every output of the board
+ * @param dirtyMask Bit n set -> output n is sent
+ * @return ESP error code
+ */
+esp_err_t AO_write_frame_blocking(uint8_t hwGroup, const uint8_t framePos[PCA9685_NUM_CHANNELS], uint16_t dirtyMask);
+
+/**
+ * @brief Queues a frame for the output task without blocking
+ * @param hwGroup HW group (board) the frame is for
+ * @param framePos Positions of every output of the board
+ * @param dirtyMask Bit n set -> output n has changed and needs to be sent
+ * @return true if the frame was queued, false if the queue is full and the caller should try again later
+ */
+bool AO_submit_frame(uint8_t hwGroup, const uint8_t framePos[PCA9685_NUM_CHANNELS], uint16_t dirtyMask);
+
+/**
+ * @brief Queues a broadcast that sets the course outputs (1-15) of every board to one position without blocking.
+ *        It goes out as a single All Call transaction and replaces anything still pending for those outputs.
+ * @param servoPos The position to set (0-255) linearized to full scale range
+ * @return true if the broadcast was queued, false if the queue is full and the caller should try again later
+ */
+bool AO_submit_broadcast(uint8_t servoPos);
+
+/**
+ * @brief When the last frame of a HW group took effect on its board
+ * @param hwGroup HW group (board)
+ * @return Timer value (see delay.h) at the STOP of the last committed frame, 0 if none has been committed
+ */
+Timer_t AO_get_frame_applied(uint8_t hwGroup);
+
+/**
+ * @brief Gives read access to the PCA9685 handle of a HW group, e.g. to report its ON ticks
+ * @param hwGroup HW group (board)
+ * @return The handle, NULL if hwGroup doesn't exist
+ */
+const PCA9685_t* AO_get_hw_group(uint8_t hwGroup);
+
+/**
+ * @brief Runs the output task, blocks until a frame arrives (or a retry is due) and writes it to its board
+ */
+void AO_run_task(void);
+
+#endif
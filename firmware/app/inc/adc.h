@@ -2,9 +2,44 @@
 #define ADC_H
 
 #include "stdint.h"
+#include "stdbool.h"
+#include "gpio.h"
 
+// The mux select lines are not wired on this board revision, every source then reads the TOUT pin as is
+#define ADC_MUX_WIRED       (ADC_MUX_A0_GPIO != UNUSED && ADC_MUX_A1_GPIO != UNUSED && ADC_MUX_A2_GPIO != UNUSED)
+
+/**
+ * @brief Initializes the ADC and the background sampler
+ */
 void ADC_init(void);
+
+/**
+ * @brief Runs one step of the background sampler, never blocks. Called every actuator control pass.
+ */
+void ADC_run_task(void);
+
+/**
+ * @brief Whether the supply rail has been sampled yet
+ * @return true once ADC_getLvADCVal holds a real reading
+ */
+bool ADC_isLvValid(void);
+
+/**
+ * @brief Number of readings of the supply rail so far, goes up each time ADC_getLvADCVal has a new one
+ * @return Readings since boot
+ */
+uint32_t ADC_getLvReadingCount(void);
+
+/**
+ * @brief Latest filtered reading of the supply rail (LV sense)
+ * @return Raw ADC counts (0 - 1023)
+ */
 uint16_t ADC_getLvADCVal(void);
+
+/**
+ * @brief Latest filtered reading of the BD sense input
+ * @return Raw ADC counts (0 - 1023)
+ */
 uint16_t ADC_getBDADCVal(void);
 
 #endif
\ No newline at end of file
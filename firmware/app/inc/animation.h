@@ -0,0 +1,56 @@
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "actuator_control.h"
+
+#define ANIM_GRID_ROWS          9   // rows from the front of the green to the back
+#define ANIM_GRID_COLS          5   // Absolute Servo ID = row * ANIM_GRID_COLS + col
+
+// Animations the engine can generate
+typedef enum {
+    ANIM_WAVE = 0,      // endless sine wave rolling over the green
+    ANIM_TSUNAMI,       // a single crest sweeping across the green, repeating
+
+    NUM_ANIM_TYPES
+} AnimType_e;
+
+/**
+ * Parameters of an animation, all in whole units so they fit straight into a POST payload.
+ * For a tsunami, center is the level of the flat green and amplitude the height of the crest above it.
+ */
+typedef struct {
+    uint8_t amplitude;      // position units above (and for a wave, below) the center
+    uint8_t center;         // position units
+    uint8_t wavelength;     // grid cells per wave, or width of the tsunami crest, at least 1
+    uint8_t speed;          // tenths of a grid cell per second
+    uint8_t direction;      // direction of travel in 256ths of a turn, 0 = along a row (col up), 64 = towards the back (row up)
+} AnimParams_t;
+#define ANIM_PARAMS_SIZE        5   // bytes of AnimParams_t in a POST payload
+
+/**
+ * @brief Loads the default parameters of every animation
+ */
+void ANIM_init(void);
+
+/**
+ * @brief Sets the parameters of an animation, a running animation picks them up on its next frame
+ * @param type Animation to set the parameters of
+ * @param params New parameters
+ */
+void ANIM_set_params(AnimType_e type, const AnimParams_t* params);
+
+/**
+ * @brief Starts an animation from its beginning
+ * @param type Animation to run
+ */
+void ANIM_start(AnimType_e type);
+
+/**
+ * @brief Renders the running animation at the current time
+ * @param positions Filled with the position of every actuator (0-255, not clamped to the servo range)
+ */
+void ANIM_render(uint8_t positions[NUM_ACTUATORS]);
+
+#endif
@@ -19,8 +19,18 @@ typedef enum {
 void BE_reset_stats(void);
 uint8_t BE_get_balls_hit(void);
 uint8_t BE_get_balls_in_hole(void);
+
+/**
+ * @brief Gets the state the state machine settled in after its last run
+ * @return Current state
+ */
+BallEstState_e BE_get_state(void);
 void BE_set_auto_dispense(bool autoDispense);
 
+/**
+ * @brief Waits for a sensor event or the next state timeout, then runs the state machine until it settles.
+ *        Blocks, so it needs a task of its own.
+ */
 void BE_run_task(void);
 
 #endif
\ No newline at end of file
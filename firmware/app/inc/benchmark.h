@@ -0,0 +1,15 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+/**
+ * Set to 1 to run the on-device microbenchmarks from app_main and log the results.
+ * They block the boot for a while, so never leave this on for normal use.
+ */
+#define BENCHMARKS_ENABLED      0
+
+/**
+ * @brief Runs every microbenchmark and logs the results
+ */
+void BENCH_run_all(void);
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef BOOT_H
+#define BOOT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Boot phases in the order they finish on a normal boot, the WiFi phases run in parallel with the rest
+typedef enum {
+    BOOT_APP_MAIN = 0,      // app_main entered
+    BOOT_I2C,               // I2C bus up
+    BOOT_NVS,               // NVS ready, course state and presets readable
+    BOOT_PWM,               // every servo driven at its saved position
+    BOOT_TIMELINE,          // stored timeline checked
+    BOOT_GPIO,
+    BOOT_ADC,
+    BOOT_BALL_QUEUE,
+    BOOT_SENSORS,
+    BOOT_TASKS,             // control, sensor and output tasks running, the course is usable
+    BOOT_WIFI_AP,           // access point up
+    BOOT_HTTPD,             // web server up, the app can connect
+
+    NUM_BOOT_PHASES
+} BootPhase_e;
+
+/**
+ * @brief Records that a boot phase has finished, the summary is logged once every phase has
+ * @param phase Boot phase that just finished
+ */
+void BOOT_mark(BootPhase_e phase);
+
+/**
+ * @brief Gets the boot timeline
+ * @param timestampsUs Filled with the time since power on each phase finished at, in us, 0 if it hasn't yet
+ */
+void BOOT_get_timeline(uint32_t timestampsUs[NUM_BOOT_PHASES]);
+
+#endif
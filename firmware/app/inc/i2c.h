@@ -3,6 +3,34 @@
 
 #include "driver/i2c.h"
 
+#define I2C_MAX_WRITE_LEN           64  // largest payload of one write, a full PCA9685 frame (16 outputs * 4 registers)
+#define I2C_MAX_READ_LEN            4   // largest payload of one read
+
+/**
+ * Set to 1 to drive the bus with the bit-banged backend in i2c.c instead of the SDK i2c driver.
+ * It runs from IRAM at Fast-mode Plus timing and only supports what the PCA9685s need (no clock
+ * stretching), so leave it off if anything else is ever put on the bus.
+ */
+#define I2C_USE_FAST_BACKEND        0
+
+// Heap usage of the transaction path, linksCreated stops growing once every transaction length has been seen
+typedef struct {
+    uint32_t linksCreated;      // command links allocated from the heap
+    uint32_t transactions;      // transactions run on the bus
+} I2CAllocStats_t;
+
+/**
+ * Priority of a queued write. When several writes are waiting for the bus, the highest priority one
+ * goes next, so e.g. a dispenser stop only ever waits for the transaction already on the wire.
+ */
+typedef enum {
+    I2C_PRIORITY_BULK = 0,      // course frames
+    I2C_PRIORITY_NORMAL,        // configuration, anything without a stated priority
+    I2C_PRIORITY_URGENT,        // dispenser start/stop
+
+    NUM_I2C_PRIORITIES
+} I2CPriority_e;
+
 /**
  * @brief i2c master initialization
  * @return ESP error code
@@ -20,15 +48,27 @@ esp_err_t I2C_master_init(void);
 esp_err_t I2C_readReg(uint8_t addr, uint8_t regAddr, uint8_t* data, size_t dataLen);
 
 /**
- * @brief Write multiple bytes
+ * @brief Write multiple bytes at normal priority
  * @param addr Slave address
  * @param regAddr Register address
  * @param data Pointer to data buffer to transmit out of
- * @param dataLen Length of data to transmit
+ * @param dataLen Length of data to transmit (up to I2C_MAX_WRITE_LEN)
  * @return ESP error code
  */
 esp_err_t I2C_writeReg(uint8_t addr, uint8_t regAddr, uint8_t* data, size_t dataLen);
 
+/**
+ * @brief Write multiple bytes through the bus manager. Blocks until the write is on the chip, but while
+ *        waiting it may be merged with other queued writes to the same slave that continue its registers.
+ * @param addr Slave address
+ * @param regAddr Register address
+ * @param data Pointer to data buffer to transmit out of
+ * @param dataLen Length of data to transmit (up to I2C_MAX_WRITE_LEN)
+ * @param priority Priority of the write against the other queued writes
+ * @return ESP error code
+ */
+esp_err_t I2C_writeRegPrio(uint8_t addr, uint8_t regAddr, uint8_t* data, size_t dataLen, I2CPriority_e priority);
+
 /**
  * @brief Read one byte
  * @param addr Slave address
@@ -47,4 +87,11 @@ esp_err_t I2C_readReg8(uint8_t addr, uint8_t regAddr, uint8_t* data);
  */
 esp_err_t I2C_writeReg8(uint8_t addr, uint8_t regAddr, uint8_t data);
 
+
+/**
+ * @brief Copies the allocation counters of the transaction path
+ * @param stats Where to put the counters
+ */
+void I2C_get_alloc_stats(I2CAllocStats_t* stats);
+
 #endif
\ No newline at end of file
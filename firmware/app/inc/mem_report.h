@@ -0,0 +1,81 @@
+#ifndef MEM_REPORT_H
+#define MEM_REPORT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+// Modules whose memory is accounted for
+typedef enum {
+    MEM_MOD_I2C = 0,
+    MEM_MOD_ACTUATOR_OUTPUT,
+    MEM_MOD_SENSORS,
+    MEM_MOD_TASKS,              // stacks and control blocks of the app tasks
+
+    NUM_MEM_MODULES
+} MemModule_e;
+
+// App tasks whose stacks are watched
+typedef enum {
+    MEM_TASK_BALL_EST = 0,
+    MEM_TASK_ACTUATOR_CONTROL,
+    MEM_TASK_ACTUATOR_OUTPUT,
+    MEM_TASK_HOUSEKEEPING,
+
+    NUM_MEM_TASKS
+} MemTask_e;
+
+typedef struct {
+    uint32_t heapAllocs;        // allocations made on the heap since boot
+    uint32_t heapBytes;         // heap taken by them
+    uint32_t staticBytes;       // statically allocated pools, never on the heap
+} MemModuleStats_t;
+
+typedef struct {
+    uint32_t stackDepth;        // stack size the task was created with
+    uint32_t stackHighWater;    // least free stack the task has ever had, same units as stackDepth
+} MemTaskStats_t;
+
+typedef struct {
+    uint32_t freeHeap;
+    uint32_t minFreeHeap;       // low water mark of the free heap since boot
+    uint32_t largestFreeBlock;  // biggest single allocation that would succeed right now
+    MemTaskStats_t tasks[NUM_MEM_TASKS];
+    MemModuleStats_t modules[NUM_MEM_MODULES];
+} MemReport_t;
+
+/**
+ * @brief Records a heap allocation made by a module
+ * @param module Module that allocated
+ * @param bytes Bytes taken from the heap
+ */
+void MEM_count_heap_alloc(MemModule_e module, size_t bytes);
+
+/**
+ * @brief Records a statically allocated pool of a module
+ * @param module Module owning the pool
+ * @param bytes Size of the pool
+ */
+void MEM_count_static(MemModule_e module, size_t bytes);
+
+/**
+ * @brief Creates an app task on a statically allocated stack and control block and watches its stack
+ * @param task Which app task it is
+ * @param function Task function
+ * @param name Task name
+ * @param stack Stack of the task, stackDepth elements
+ * @param stackDepth Stack size
+ * @param priority Task priority
+ * @param tcb Control block of the task
+ */
+void MEM_create_static_task(MemTask_e task, TaskFunction_t function, const char* name, StackType_t* stack,
+                            uint32_t stackDepth, UBaseType_t priority, StaticTask_t* tcb);
+
+/**
+ * @brief Gathers the memory report, finding the largest free block allocates and frees on the heap
+ * @param report Filled with the report
+ */
+void MEM_get_report(MemReport_t* report);
+
+#endif
@@ -2,7 +2,8 @@
 #define PCA9685_H
 
 #include <stdint.h>
-#include "driver/i2c.h"
+#include "i2c.h"
+#include "delay.h"
 
 // REGISTER ADDRESSES
 #define PCA9685_MODE1               0x00        // Mode Register 1
@@ -45,26 +46,62 @@
 
 #define FREQUENCY_OSCILLATOR        25000000    //Int. osc. frequency in datasheet
 
-#define DEFAULT_SERVO_FREQ          50.0F
+#define DEFAULT_SERVO_FREQ          50
+
+#define PCA9685_NUM_CHANNELS        16          // Number of PWM outputs on each chip
+#define PCA9685_SHADOW_INVALID      0xFFFF      // Shadow value for an output whose register contents are unknown
+#define PCA9685_NUM_TICKS           4096        // PWM counter ticks per period
+#define PCA9685_ALLCALL_ADDR        0x70        // LED All Call address every chip answers to with MODE1_ALLCAL set (power on default)
 
 typedef struct{
     uint8_t addr;       // I2C slave address
     uint8_t isLed;      // Is this chip being used to control LEDs (true = LED, false = Servos)
-    float osc_freq;     // Tested true osc_freq of the chip
+    uint32_t osc_freq;  // Tested true osc_freq of the chip
+    I2CPriority_e priority; // Bus priority of the output writes made through this handle
+
+    const uint16_t* offLut;                   // Position -> OFF tick table for this chip's variant, set by PCA9685_initHandle
+    uint16_t offShadow[PCA9685_NUM_CHANNELS]; // Last OFF tick written to each output through this handle
+    uint16_t onTick[PCA9685_NUM_CHANNELS];    // Tick each output's pulse starts on, 0 unless set with PCA9685_setOnTicks
+
+    Timer_t frameApplied;                     // When the last frame committed through this handle took effect
+    uint32_t framesApplied;                   // Number of frames committed through this handle
 }PCA9685_t;
 
 /**
- * @brief Initializes the PCA9685 pwm driver
+ * @brief Prepares a handle (lookup table, shadow registers) without touching the chip.
+ *        Use this for extra handles to a chip that has already been initialized.
+ * @param pca9685 PCA9685 handle
+ */
+void PCA9685_initHandle(PCA9685_t* pca9685);
+
+/**
+ * @brief Initializes the PCA9685 pwm driver and its handle
+ * @param pca9685 PCA9685 handle, its shadow registers are invalidated
+ */
+void PCA9685_init(PCA9685_t* pca9685);
+
+/**
+ * @brief Sets the tick each output's pulse starts on. The pulse width is unchanged, the OFF tick moves with it.
+ *        Takes effect on the next write of each output, the shadow registers are invalidated so that happens.
  * @param pca9685 PCA9685 handle
+ * @param onTick ON tick of every output (0 - 4095)
  */
-void PCA9685_init(const PCA9685_t* pca9685);
+void PCA9685_setOnTicks(PCA9685_t* pca9685, const uint16_t onTick[PCA9685_NUM_CHANNELS]);
 
 /**
  * @brief Sets the frequency for the entire chip (24Hz - 1526Hz)
  * @param pca9685 PCA9685 handle
  * @param freq Frequency to set
  */
-void PCA9685_setFreq(const PCA9685_t* pca9685, float freq);
+void PCA9685_setFreq(const PCA9685_t* pca9685, uint16_t freq);
+
+/**
+ * @brief Converts a servo position to the OFF tick written to the chip, using the handle's lookup table
+ * @param pca9685 PCA9685 handle
+ * @param servoPos The position (0-255) linearized to full scale range
+ * @return OFF tick (0 - 4095)
+ */
+uint16_t PCA9685_servoPosToOffTick(const PCA9685_t* pca9685, uint8_t servoPos);
 
 /**
  * @brief Sets the relative position of a servo via PWM duty cycle manipulation
@@ -75,10 +112,59 @@ void PCA9685_setFreq(const PCA9685_t* pca9685, float freq);
 void PCA9685_setServoPos(const PCA9685_t* pca9685, uint8_t outputPin, uint8_t servoPos);
 
 /**
- * @brief Sets the servo position controlled by the entire chip via PWM duty cycle manipulation
- * @param pca9685 PCA9685 handle
+ * @brief Sets every output of the chip (all 16, output 0 included) to the same position with one ALL_LED write.
+ *        All outputs switch on at tick 0, their ON ticks are only restored by their next individual write.
+ * @param pca9685 PCA9685 handle, all of its shadow registers are updated on success
  * @param servoPos The position to set (0-255) linearized to full scale range
+ * @return ESP error code
+ */
+esp_err_t PCA9685_setAllServoPos(PCA9685_t* pca9685, uint8_t servoPos);
+
+/**
+ * @brief Sets the positions of a contiguous run of servos in a single auto-increment I2C burst
+ * @param pca9685 PCA9685 handle, its shadow registers are updated on success
+ * @param firstPin First servo output to set (0 - 15)
+ * @param numPins Number of consecutive outputs to set, starting at firstPin
+ * @param servoPos Array of numPins positions (0-255) linearized to full scale range
+ * @return ESP error code
+ */
+esp_err_t PCA9685_setServoPosRange(PCA9685_t* pca9685, uint8_t firstPin, uint8_t numPins, const uint8_t* servoPos);
+
+/**
+ * @brief Sends only the servos of a contiguous run whose OFF tick differs from the shadow registers.
+ *        Adjacent changed outputs are merged into one auto-increment burst each.
+ * @param pca9685 PCA9685 handle, its shadow registers are updated for every burst that succeeds
+ * @param firstPin First servo output of the run (0 - 15)
+ * @param numPins Number of consecutive outputs in the run, starting at firstPin
+ * @param servoPos Array of numPins positions (0-255) linearized to full scale range
+ * @param dirtyMask Bit n set means servoPos[n] may have changed, outputs with a clear bit are skipped
+ * @return ESP error code of the first failed burst, ESP_OK otherwise
+ */
+esp_err_t PCA9685_updateServoPosRange(PCA9685_t* pca9685, uint8_t firstPin, uint8_t numPins, const uint8_t* servoPos, uint16_t dirtyMask);
+
+/**
+ * @brief Commits a frame so every changed output of the chip switches on the same PWM edge.
+ *        The changed outputs (dirty and differing from the shadow registers) and everything between them go
+ *        out as one burst, and with MODE2_OCH clear the chip latches the whole burst at its STOP.
+ * @param pca9685 PCA9685 handle, its shadow registers and frame timestamp are updated on success
+ * @param servoPos Positions of every output (0-255) linearized to full scale range. Outputs between two
+ *                 changed ones are rewritten from it too, so it must hold their current positions.
+ * @param dirtyMask Bit n set means servoPos[n] may have changed
+ * @return ESP error code
+ */
+esp_err_t PCA9685_commitServoFrame(PCA9685_t* pca9685, const uint8_t servoPos[PCA9685_NUM_CHANNELS], uint16_t dirtyMask);
+
+/**
+ * @brief Sets the same run of outputs on several chips at once, one burst to the All Call address
+ * @param pca9685s Array of handles of the chips on the bus, all of the same variant (servo or LED).
+ *                 The ON ticks of the first handle are used for every chip, outputs of the other chips
+ *                 with a different ON tick get an invalid shadow and have to be written again.
+ * @param numPca9685s Number of handles in the array, their shadow registers are updated on success
+ * @param firstPin First servo output to set (0 - 15)
+ * @param numPins Number of consecutive outputs to set, starting at firstPin
+ * @param servoPos Array of numPins positions (0-255) linearized to full scale range, the same on every chip
+ * @return ESP error code
  */
-void PCA9685_setAllServoPos(const PCA9685_t* pca9685, uint8_t servoPos);
+esp_err_t PCA9685_broadcastServoPosRange(PCA9685_t* pca9685s, uint8_t numPca9685s, uint8_t firstPin, uint8_t numPins, const uint8_t* servoPos);
 
 #endif
\ No newline at end of file
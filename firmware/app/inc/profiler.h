@@ -0,0 +1,68 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdint.h>
+#include "delay.h"
+
+/**
+ * Log scale histogram buckets. Bucket 0 counts 0 us, bucket i counts [2^(i-1), 2^i) us and the last bucket
+ * counts everything from 2^(PROF_NUM_BUCKETS-2) us up.
+ */
+#define PROF_NUM_BUCKETS        16
+
+// Profiled quantities, one histogram each
+typedef enum {
+    // execution time of a *_run_task call, for the sensors a debounce timer callback
+    PROF_EXEC_SNS = 0,
+    PROF_EXEC_ADC,
+    PROF_EXEC_TL,
+    PROF_EXEC_AC,
+    PROF_EXEC_BE,
+    PROF_EXEC_BQ,
+    PROF_EXEC_NVS,
+
+    // how long after the end of its debounce window a sensor got confirmed
+    PROF_SNS_CONFIRM_DELAY,
+
+    // wake-up jitter of a periodic task, how far the time between two passes is from the period,
+    // in TaskMonId_e order
+    PROF_JITTER_ACTUATOR_CONTROL,
+    PROF_JITTER_HOUSEKEEPING,
+
+    NUM_PROF_HISTS
+} ProfHist_e;
+
+typedef struct {
+    uint32_t count;
+    uint32_t maxUs;
+    uint64_t totalUs;
+    uint32_t buckets[PROF_NUM_BUCKETS];
+} ProfHist_t;
+
+/**
+ * @brief Adds a sample to a histogram
+ * @param hist Histogram
+ * @param us Sample in us
+ */
+void PROF_record(ProfHist_e hist, uint32_t us);
+
+/**
+ * @brief Adds the time since start to a histogram, for timing a call: start = TIMER_restart(), call, PROF_end
+ * @param hist Histogram
+ * @param start Timer restarted right before the profiled call
+ */
+void PROF_end(ProfHist_e hist, Timer_t start);
+
+/**
+ * @brief Gets a copy of a histogram
+ * @param hist Histogram
+ * @param out Filled with the histogram
+ */
+void PROF_get_hist(ProfHist_e hist, ProfHist_t* out);
+
+/**
+ * @brief Clears every histogram
+ */
+void PROF_reset(void);
+
+#endif
@@ -2,9 +2,98 @@
 #define SENSORS_H
 
 #include <stdbool.h>
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+
+#define SNS_CAPTURE_LEN         1024    // raw edges the capture keeps, the latest ones once it wraps
+
+// Ball sensors, also the source of a debounced sensor event
+typedef enum {
+    SNS_BALL_IN_HOLE = 0,
+    SNS_BALL_IN_GUTTER,
+    SNS_BALL_DEP,
+    SNS_BALL_QUEUE,
+
+    NUM_SENSORS,
+    SNS_WAKE = NUM_SENSORS,     // not from a sensor, see SNS_wake
+} SensorId_e;
+
+// A debounced sensor event, sent once each time a sensor is confirmed
+typedef struct {
+    SensorId_e sensor;
+    int64_t timestampUs;        // esp_timer time of the edge the sensor was confirmed from, 0 for SNS_WAKE
+} SnsEvent_t;
+
+// A raw edge out of the capture
+typedef struct {
+    uint32_t timeUs;            // since the capture started, wraps after about 71 minutes
+    uint8_t sensor;             // SensorId_e
+    uint8_t level;
+} SnsCaptureEdge_t;
+
+typedef struct {
+    bool running;
+    uint32_t numEdges;          // edges kept
+    uint32_t lostEdges;         // oldest edges overwritten once the capture wrapped
+    uint32_t lengthUs;          // from the start of the capture to its stop, or to now while it runs
+} SnsCaptureInfo_t;
 
 void SNS_init(void);
 
+/**
+ * @brief Blocks until a sensor is confirmed or the timeout runs out. Only the ball in hole, gutter and
+ *        departure sensors send events, the ball queue sensor is only counted.
+ * @param event Filled with the event
+ * @param timeout Ticks to wait at most, portMAX_DELAY to wait forever
+ * @return true if there was an event, false on timeout
+ */
+bool SNS_wait_event(SnsEvent_t* event, TickType_t timeout);
+
+/**
+ * @brief Wakes whoever waits in SNS_wait_event with SNS_WAKE, for changes that don't come from a sensor
+ */
+void SNS_wake(void);
+
+/**
+ * @brief Takes the oldest confirmation of a sensor that hasn't been taken yet. Every confirmation is
+ *        counted, so balls in quick succession are each taken once.
+ * @param sensor Sensor
+ * @param timestampUs Filled with the esp_timer time of the edge it was confirmed from, can be NULL
+ * @return true if there was a confirmation to take
+ */
+bool SNS_take(SensorId_e sensor, int64_t* timestampUs);
+
+/**
+ * @brief Gets the number of edges the ISR had to drop because the edge ring was full
+ * @return Dropped edges since boot
+ */
+uint32_t SNS_get_dropped_edges(void);
+
+/**
+ * @brief Starts capturing the raw sensor edges with their timestamps, for replaying them on a host.
+ *        Whatever an earlier capture recorded is discarded.
+ */
+void SNS_capture_start(void);
+
+/**
+ * @brief Stops the capture, what it recorded is kept until the next start
+ */
+void SNS_capture_stop(void);
+
+/**
+ * @brief Gets the state of the capture
+ * @param info Filled with the state
+ */
+void SNS_capture_get_info(SnsCaptureInfo_t* info);
+
+/**
+ * @brief Gets a captured edge, stop the capture first or the oldest edges can be overwritten while reading
+ * @param index Edge, 0 is the oldest one kept
+ * @param edge Filled with the edge
+ * @return true if there is an edge at index
+ */
+bool SNS_capture_get_edge(uint32_t index, SnsCaptureEdge_t* edge);
+
 bool SNS_get_ball_in_hole(void);
 void SNS_clear_ball_in_hole(void);
 
@@ -17,6 +106,4 @@ void SNS_clear_ball_dep(void);
 bool SNS_get_ball_queue(void);
 void SNS_clear_ball_queue(void);
 
-void SNS_run_task(void);
-
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,53 @@
+#ifndef TASK_MONITOR_H
+#define TASK_MONITOR_H
+
+#include <stdint.h>
+
+// Periodic tasks whose deadlines are tracked
+typedef enum {
+    TASKMON_ACTUATOR_CONTROL = 0,   // task_actuator_control
+    TASKMON_HOUSEKEEPING,           // task_100ms
+
+    NUM_TASKMON_TASKS
+} TaskMonId_e;
+
+typedef struct {
+    uint32_t periodUs;          // period the task claims to run at
+    uint32_t runs;
+    uint32_t misses;            // passes that started more than a period after the previous one, or ran longer than one
+    uint32_t worstOverrunUs;    // most a pass has ever gone past its period by
+    uint32_t worstExecUs;       // longest a pass has ever taken
+} TaskMonStats_t;
+
+/**
+ * @brief Sets the period a task is checked against, call before the task starts
+ * @param task Periodic task
+ * @param periodMs Task period
+ */
+void TASKMON_init(TaskMonId_e task, uint32_t periodMs);
+
+/**
+ * @brief Marks the start of a pass, call right after the task wakes up. Also feeds the task's jitter histogram.
+ * @param task Periodic task
+ */
+void TASKMON_pass_start(TaskMonId_e task);
+
+/**
+ * @brief Marks the end of a pass, call right before the task goes back to sleep
+ * @param task Periodic task
+ */
+void TASKMON_pass_end(TaskMonId_e task);
+
+/**
+ * @brief Gets the deadline counters of a task
+ * @param task Periodic task
+ * @param stats Filled with the counters
+ */
+void TASKMON_get_stats(TaskMonId_e task, TaskMonStats_t* stats);
+
+/**
+ * @brief Clears the deadline counters of every task, the periods are kept
+ */
+void TASKMON_reset_stats(void);
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef TIMELINE_H
+#define TIMELINE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "actuator_control.h"
+
+/**
+ * Timeline binary format, all values little endian. It is stored as is in the "timeline" flash partition.
+ * 
+ * Header (TL_HEADER_SIZE bytes)
+ *   uint32 magic         TL_MAGIC
+ *   uint16 numSegments
+ *   uint16 reserved      0
+ *   uint32 checksum      FNV-1a 32 of all the segment bytes
+ * 
+ * Segment (TL_SEGMENT_SIZE bytes), one per keyframe
+ *   uint16 durationMs    time taken to reach the keyframe from the previous one
+ *   uint8  easing        ACEasing_e
+ *   uint8  positions[NUM_ACTUATORS]
+ */
+#define TL_MAGIC                0x314C5450  // "PTL1"
+#define TL_HEADER_SIZE          12
+#define TL_SEGMENT_SIZE         (3 + NUM_ACTUATORS)
+
+// How a timeline is played, also the command byte of POST /timeline_cmd
+typedef enum {
+    TL_STOP = 0,
+    TL_ONE_SHOT,        // play once and hold the last keyframe
+    TL_LOOP,            // after the last keyframe go on to the first one again
+    TL_PING_PONG,       // play forwards, then backwards, and so on
+
+    NUM_TL_COMMANDS
+} TLCommand_e;
+
+/**
+ * @brief Finds the timeline partition and checks the timeline stored in it
+ */
+void TL_init(void);
+
+/**
+ * @brief Starts writing a new timeline to flash, stops playback and erases the old one
+ * @param totalLen Size of the whole timeline, header included
+ * @return ESP error code
+ */
+esp_err_t TL_upload_begin(size_t totalLen);
+
+/**
+ * @brief Writes the next part of the timeline being uploaded
+ * @param data Timeline bytes, following on from the previous call
+ * @param len Number of bytes
+ * @return ESP error code
+ */
+esp_err_t TL_upload_write(const uint8_t* data, size_t len);
+
+/**
+ * @brief Finishes the upload and checks the timeline as it was written to flash
+ * @return ESP_OK if the stored timeline is complete and valid
+ */
+esp_err_t TL_upload_end(void);
+
+/**
+ * @brief Starts playing the stored timeline from its first keyframe, or stops it
+ * @param command How to play it, TL_STOP stops playback and holds the course where it is
+ * @return ESP_ERR_INVALID_STATE if there is no valid timeline to play
+ */
+esp_err_t TL_command(TLCommand_e command);
+
+/**
+ * @brief Whether a timeline is playing
+ * @return true while playing
+ */
+bool TL_is_playing(void);
+
+/**
+ * @brief Runs the timeline player, hands each keyframe to actuator control when it is due
+ */
+void TL_run_task(void);
+
+#endif
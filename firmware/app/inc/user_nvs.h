@@ -4,8 +4,66 @@
 #include "actuator_control.h"
 #include "esp_err.h"
 
+#define NVS_NUM_PRESETS         8       // preset slots, ids 0 to NVS_NUM_PRESETS - 1
+#define NVS_PRESET_NAME_LEN     16      // bytes, not null terminated when all are used
+
+// Course state persistence counters, see NVS_get_stats
+typedef struct {
+    uint32_t requests;          // course states handed to NVS_request_course_state_save
+    uint32_t writes;            // course states actually written to flash
+    uint32_t skipped;           // settled course states that matched what was already in flash
+    uint32_t failures;          // writes that returned an error
+    uint32_t lastWriteUs;       // time taken by the latest write (open, set, commit, close)
+    uint32_t maxWriteUs;        // slowest write since boot
+} NVSStats_t;
+
 void NVS_init(void);
 esp_err_t NVS_write_course_state(uint8_t courseState[NUM_ACTUATORS]);
 esp_err_t NVS_read_course_state(uint8_t output[NUM_ACTUATORS]);
 
+/**
+ * @brief Hands over a course state to be saved, it is only written once it and the course have settled.
+ *        Cheap, never touches flash, so it is safe to call from the control loop.
+ * @param courseState Actuator positions to save
+ */
+void NVS_request_course_state_save(const uint8_t courseState[NUM_ACTUATORS]);
+
+/**
+ * @brief Writes the latest requested course state once it has been stable for NVS_SAVE_SETTLE_MS and the
+ *        course has stopped moving, unless flash already holds the same state. A failed write stays pending
+ *        and is tried again NVS_SAVE_SETTLE_MS later.
+ */
+void NVS_run_task(void);
+
+/**
+ * @brief Gets the course state persistence counters
+ * @param stats Filled with the counters
+ */
+void NVS_get_stats(NVSStats_t* stats);
+
+/**
+ * @brief Saves a named course layout to a preset slot, replacing what was in it
+ * @param id Preset slot
+ * @param name Preset name, NVS_PRESET_NAME_LEN bytes, padded with zeros if shorter
+ * @param positions Actuator positions of the layout
+ * @return ESP error code
+ */
+esp_err_t NVS_save_preset(uint8_t id, const char name[NVS_PRESET_NAME_LEN], const uint8_t positions[NUM_ACTUATORS]);
+
+/**
+ * @brief Deletes the preset in a slot
+ * @param id Preset slot
+ * @return ESP error code, ESP_ERR_NOT_FOUND if the slot is empty
+ */
+esp_err_t NVS_delete_preset(uint8_t id);
+
+/**
+ * @brief Gets a preset from the RAM copy of the preset slots, never touches flash
+ * @param id Preset slot
+ * @param name Filled with the preset name, can be NULL
+ * @param positions Filled with the actuator positions, can be NULL
+ * @return true if the slot holds a preset
+ */
+bool NVS_get_preset(uint8_t id, char name[NVS_PRESET_NAME_LEN], uint8_t positions[NUM_ACTUATORS]);
+
 #endif
\ No newline at end of file
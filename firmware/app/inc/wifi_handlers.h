@@ -9,11 +9,24 @@ esp_err_t POST_courseState_handler(httpd_req_t *req);
 esp_err_t POST_resetStats_handler(httpd_req_t *req);
 esp_err_t POST_settings_handler(httpd_req_t *req);
 esp_err_t POST_dispenseBall_handler(httpd_req_t *req);
+esp_err_t POST_animation_handler(httpd_req_t *req);
+esp_err_t POST_timeline_handler(httpd_req_t *req);
+esp_err_t POST_timelineCmd_handler(httpd_req_t *req);
+esp_err_t POST_presetSave_handler(httpd_req_t *req);
+esp_err_t POST_presetDelete_handler(httpd_req_t *req);
+esp_err_t POST_presetRecall_handler(httpd_req_t *req);
+esp_err_t POST_metricsReset_handler(httpd_req_t *req);
+esp_err_t POST_sensorCaptureCmd_handler(httpd_req_t *req);
 
 // GET handlers
 esp_err_t GET_errorCodes_handler(httpd_req_t *req);
 esp_err_t GET_debugMsg_handler(httpd_req_t *req);
 esp_err_t GET_stats_handler(httpd_req_t *req);
+esp_err_t GET_presets_handler(httpd_req_t *req);
+esp_err_t GET_bootTimeline_handler(httpd_req_t *req);
+esp_err_t GET_metrics_handler(httpd_req_t *req);
+esp_err_t GET_memory_handler(httpd_req_t *req);
+esp_err_t GET_sensorCapture_handler(httpd_req_t *req);
 
 // Temp handler for testing purposes
 esp_err_t echo_post_handler(httpd_req_t *req);
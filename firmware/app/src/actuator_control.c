@@ -5,24 +5,59 @@
 #include <stdlib.h>
 
 #include "actuator_control.h"
-#include "pca9685.h"
+#include "actuator_output.h"
 #include "user_nvs.h"
+#include "delay.h"
+#include "adc.h"
+#include "animation.h"
 
-#define STEP_MAGNITUDE              1   // the step increase of the current servo position towards its desired position
-#define AC_TASK_DELAY               20
 
 /**
- * We are using "roll-out" groups to roll out servo motor changes incrementally to reduce
- * current draw at a given time.
- * 
- * Since the number of actuators are fixed, the number of roll out groups determines the
- * number of members (servo motors) per group.
- * 
- * NOTE: make sure NUM_ACTUATORS is evenly divisible by NUM_ROLLOUT_GROUPS 
+ * Motion limits of a course servo, in position units (see MAX_SERVO_POSITION). Every transition follows a
+ * trapezoidal velocity profile built from these: accelerate at MAX_ACCELERATION up to MAX_VELOCITY, cruise,
+ * then decelerate into the target. Short moves never reach MAX_VELOCITY and become a triangle.
+ */
+#define MAX_VELOCITY                120     // position units per second
+#define MAX_ACCELERATION            400     // position units per second^2
+
+/**
+ * Current budget of the servo supply. Every pass, the servos that are due to be sent are packed under it
+ * using the estimated current of each move, the rest keep their last position and go out on a later pass
+ * (with a bigger step by then). A small edit goes out in one pass, a big transition is only held back as
+ * much as the supply needs.
+ */
+#define SUPPLY_BUDGET_MA            3000
+
+/**
+ * Supply feedback. The budget above is only where the scheduler starts, from then on it follows the
+ * filtered supply rail reading (AIMD): it is halved on every new reading below SUPPLY_SAG_ADC, and grows
+ * by BUDGET_INCREASE_MA on every new reading above SUPPLY_HEALTHY_ADC. Readings are raw counts of the LV
+ * sense divider, calibrate them on the board. Without the ADC mux wired (see adc.h) there is no LV reading,
+ * only the bare TOUT pin, so the budget then stays at SUPPLY_BUDGET_MA.
+ */
+#define SUPPLY_SAG_ADC              830
+#define SUPPLY_HEALTHY_ADC          880
+#define BUDGET_INCREASE_MA          50      // per new rail reading, one every 6 passes (60 ms), about 0.8 A/s
+#define MIN_BUDGET_MA               (2 * SERVO_START_MA)    // keep a couple of servos moving even on a weak supply
+#define MAX_BUDGET_MA               8000                    // rating of the servo supply
+
+/**
+ * Default current model of a servo move: a fixed draw for starting to move at all plus a part per position
+ * unit of the step, higher when pushing the green up than when letting it down.
+ */
+#define SERVO_START_MA              150
+#define SERVO_MA_PER_UNIT_UP        40
+#define SERVO_MA_PER_UNIT_DOWN      20
+
+#define MS_PER_S                    1000
+#define US_PER_S                    1000000
+#define PROFILE_Q_BITS              16      // fraction bits of the distances computed along the profile
+
+/**
+ * A servo is only re-sent once its position has moved more than this many units away from what was
+ * last sent to it. The final (desired) position is always sent, so the deadband never leaves a servo short.
  */
-#define NUM_ROLLOUT_GROUPS          3
-#define NUM_MEMBERS_PER_RO_GROUP   (NUM_ACTUATORS/NUM_ROLLOUT_GROUPS)
-#define ROLLOUT_GROUP_DELAY_MS      20
+#define POSITION_DEADBAND           0
 
 /**
  * Every 15 servos are being controlled by a different board, we are calling each board a HW group.
@@ -35,7 +70,6 @@
  * The reason "Relative Servo ID" starts at 1, is becuase each board can actually control 16 total servos, but
  * servo 0 is used for a different purpose, not related to actuator control, leaving us with 15 servos.
  */
-#define NUM_HW_GROUPS               3
 #define NUM_SERVOS_PER_HW_GROUP     15
 #define REL_SERVO_ID_OFFSET         1
 
@@ -45,103 +79,505 @@
 #define INIT_SERVOS_DELAY_MS        1500
 
 
+// Estimated current of one servo move, see SERVO_START_MA
+typedef struct {
+    uint16_t startMa;
+    uint16_t maPerUnitUp;
+    uint16_t maPerUnitDown;
+} ServoCurrentModel_t;
+
 // struct describing the actuator control task
 typedef struct {
     uint8_t currentPos[NUM_ACTUATORS];
     uint8_t desiredPos[NUM_ACTUATORS];
+    uint8_t sentPos[NUM_ACTUATORS];     // last position handed to each servo's board
+
+    uint8_t hwGroupPos[NUM_HW_GROUPS][PCA9685_NUM_CHANNELS];  // positions laid out by board output
+    uint16_t hwGroupDirty[NUM_HW_GROUPS];                       // bit n set -> output n of the board needs to be sent
     ACMode_e mode;
 
+    // transition in progress, see plan_transition
+    uint8_t startPos[NUM_ACTUATORS];    // positions the transition started from
+    Timer_t transitionStart;
+    uint32_t maxDelta;                  // distance of the longest move, the profile is planned for this one
+    uint32_t accelMs;                   // time spent accelerating, and again decelerating
+    uint32_t cruiseMs;                  // time spent at MAX_VELOCITY, 0 for a triangular profile
+    uint32_t timedMs;                   // 0 -> velocity profile, otherwise the transition takes this long
+    ACEasing_e easing;                  // easing of a timed transition
+    bool inTransition;
+
+    bool newTarget;                     // desired positions changed, plan a new transition on the next pass
+    uint32_t targetMs;                  // requested duration of the new transition, 0 for as fast as allowed
+    ACEasing_e targetEasing;
+
+    ACMode_e animMode;                  // animation currently driving the course, STATIC when none is
+
+    // current budget scheduler, see update_dirty_actuators
+    ServoCurrentModel_t currentModel[NUM_ACTUATORS];
+    uint32_t currentBudgetMa;
+    uint32_t lvReadings;                // rail readings the budget has followed so far
+    uint8_t scheduleStart;              // first servo considered next pass, where the budget last ran out
+
     bool saveCourseState;
+    bool resetPending;      // RESET was requested, the course is flattened on the next pass
 } ActControl_t;
 ActControl_t actControl;
 
+// Where an Absolute Servo ID lives in hardware
+typedef struct {
+    uint8_t hwGroup;    // HW group (board) the servo is wired to
+    uint8_t channel;    // PCA9685 output on that board, i.e. the Relative Servo ID
+} ServoMap_t;
+
 /**
- * HW group array holding the PCA9685 instances.
- * 
- * hwGroups[0] -> 0-14  Absolute Servo ID
- * hwGroups[1] -> 15-29 Absolute Servo ID
- * hwGroups[2] -> 20-44 Absolute Servo ID
- * 
- */ 
-const PCA9685_t hwGroups[NUM_HW_GROUPS] = {
-    { .addr = 0x43, .isLed = false, .osc_freq = 26434765.0 },
-    { .addr = 0x61, .isLed = false, .osc_freq = 26484736.0 },
-    { .addr = 0x62, .isLed = false, .osc_freq = 26484736.0 },
-};
+ * Absolute Servo ID -> (HW group, Relative Servo ID), computed once in init_servo_map so the
+ * control loop never has to divide or take a modulo to find a servo.
+ */
+ServoMap_t servoMap[NUM_ACTUATORS];
+
+void init_current_model(void);
+uint32_t estimate_move_current_ma(uint8_t servo, int step);
+void update_current_budget(void);
+uint32_t isqrt32(uint32_t x);
+void plan_transition(void);
+bool run_animation(void);
+int64_t profile_distance_q(uint32_t elapsedMs);
+int64_t eased_distance_q(uint32_t elapsedMs);
+void set_desired_positions(const uint8_t desiredPos[NUM_ACTUATORS]);
+
+void init_servo_map(void)
+{
+    for (uint8_t i = 0; i < NUM_ACTUATORS; i++)
+    {
+        servoMap[i].hwGroup = i / NUM_SERVOS_PER_HW_GROUP;
+        servoMap[i].channel = (i % NUM_SERVOS_PER_HW_GROUP) + REL_SERVO_ID_OFFSET;
+    }
+}
+
+// Every servo starts with the default model, a servo that is known to work harder can be given its own
+void init_current_model(void)
+{
+    for (uint8_t i = 0; i < NUM_ACTUATORS; i++)
+    {
+        actControl.currentModel[i].startMa = SERVO_START_MA;
+        actControl.currentModel[i].maPerUnitUp = SERVO_MA_PER_UNIT_UP;
+        actControl.currentModel[i].maPerUnitDown = SERVO_MA_PER_UNIT_DOWN;
+    }
+
+    actControl.currentBudgetMa = SUPPLY_BUDGET_MA;
+    actControl.lvReadings = 0;
+    actControl.scheduleStart = 0;
+}
+
+uint32_t estimate_move_current_ma(uint8_t servo, int step)
+{
+    const ServoCurrentModel_t* model = &actControl.currentModel[servo];
+    const uint32_t maPerUnit = (step > 0) ? model->maPerUnitUp : model->maPerUnitDown;
+
+    return model->startMa + maPerUnit * abs(step);
+}
+
+// Follow the supply rail, back off hard when it sags and creep back up while it holds
+void update_current_budget(void)
+{
+#if ADC_MUX_WIRED
+    // a reading comes in every few passes, each one only counts once
+    if (!ADC_isLvValid() || ADC_getLvReadingCount() == actControl.lvReadings)
+    {
+        return;
+    }
+    actControl.lvReadings = ADC_getLvReadingCount();
+
+    const uint16_t rail = ADC_getLvADCVal();
+
+    if (rail < SUPPLY_SAG_ADC)
+    {
+        actControl.currentBudgetMa /= 2;
+        if (actControl.currentBudgetMa < MIN_BUDGET_MA)
+        {
+            actControl.currentBudgetMa = MIN_BUDGET_MA;
+        }
+    }
+    else if (rail > SUPPLY_HEALTHY_ADC)
+    {
+        actControl.currentBudgetMa += BUDGET_INCREASE_MA;
+        if (actControl.currentBudgetMa > MAX_BUDGET_MA)
+        {
+            actControl.currentBudgetMa = MAX_BUDGET_MA;
+        }
+    }
+#endif
+}
+
+// Hand the dirty servos of a HW group to the output task as one frame
+void submit_hw_group(uint8_t hwGroup)
+{
+    if (actControl.hwGroupDirty[hwGroup] == 0)
+    {
+        return;
+    }
+
+    // if the output queue is full, the group stays dirty and goes out with newer positions next pass
+    if (AO_submit_frame(hwGroup, actControl.hwGroupPos[hwGroup], actControl.hwGroupDirty[hwGroup]))
+    {
+        actControl.hwGroupDirty[hwGroup] = 0;
+    }
+}
+
+// Integer square root, floor(sqrt(x))
+uint32_t isqrt32(uint32_t x)
+{
+    uint32_t root = 0;
+    uint32_t bit = 1UL << 30;
+
+    while (bit > x)
+    {
+        bit >>= 2;
+    }
+
+    while (bit != 0)
+    {
+        if (x >= root + bit)
+        {
+            x -= root + bit;
+            root = (root >> 1) + bit;
+        }
+        else
+        {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+
+    return root;
+}
 
 /**
- * Array that holds the Absolute Servo IDs arranged in the rollout order.
+ * Plan a transition from the current to the desired positions.
  * 
- * Members in the same group are moved at the same time (without blocking delay).
+ * The profile is planned for the longest move only. Every other actuator follows the same profile scaled
+ * down to its own distance, so they all start and arrive together and the green keeps its shape on the way.
+ */
+void plan_transition(void)
+{
+    actControl.maxDelta = 0;
+
+    for (uint8_t i = 0; i < NUM_ACTUATORS; i++)
+    {
+        const uint32_t delta = abs(actControl.desiredPos[i] - actControl.currentPos[i]);
+
+        if (delta > actControl.maxDelta)
+        {
+            actControl.maxDelta = delta;
+        }
+    }
+
+    memcpy(actControl.startPos, actControl.currentPos, NUM_ACTUATORS);
+    actControl.transitionStart = TIMER_restart();
+    actControl.inTransition = (actControl.maxDelta != 0);
+
+    const uint32_t D = actControl.maxDelta;
+    const uint32_t V = MAX_VELOCITY;
+    const uint32_t A = MAX_ACCELERATION;
+
+    if (D * A >= V * V)
+    {
+        // trapezoid, V^2/A is the distance covered accelerating to and decelerating from V
+        actControl.accelMs = (V * MS_PER_S) / A;
+        actControl.cruiseMs = ((D * A - V * V) * MS_PER_S) / (A * V);
+    }
+    else
+    {
+        // triangle, accelerate for half the distance and decelerate for the other half
+        actControl.accelMs = isqrt32((D * US_PER_S) / A);
+        actControl.cruiseMs = 0;
+    }
+
+    // a timed transition only replaces the profile if it is slower, the motion limits always hold
+    const uint32_t profileMs = 2 * actControl.accelMs + actControl.cruiseMs;
+
+    actControl.timedMs = (actControl.targetMs > profileMs) ? actControl.targetMs : 0;
+    actControl.easing = actControl.targetEasing;
+}
+
+/**
+ * Distance covered along a timed transition after elapsedMs, in Q16 position units.
+ * The fraction of time gone, s, is eased in Q16: in s^2, out 1 - (1 - s)^2, in-out s^2 * (3 - 2s).
  */
-uint8_t rolloutGroups[NUM_ROLLOUT_GROUPS][NUM_MEMBERS_PER_RO_GROUP];
+int64_t eased_distance_q(uint32_t elapsedMs)
+{
+    const int64_t one = 1 << PROFILE_Q_BITS;
+    int64_t s = ((int64_t)elapsedMs << PROFILE_Q_BITS) / actControl.timedMs;
+    int64_t eased;
+
+    if (s > one)
+    {
+        s = one;
+    }
+
+    switch (actControl.easing)
+    {
+        case EASE_IN:
+            eased = (s * s) >> PROFILE_Q_BITS;
+            break;
+
+        case EASE_OUT:
+            eased = one - (((one - s) * (one - s)) >> PROFILE_Q_BITS);
+            break;
+
+        case EASE_IN_OUT:
+            eased = (((s * s) >> PROFILE_Q_BITS) * (3 * one - 2 * s)) >> PROFILE_Q_BITS;
+            break;
+
+        case EASE_LINEAR:
+        default:
+            eased = s;
+            break;
+    }
+
+    return (eased * actControl.maxDelta);
+}
+
+// Distance covered along the profile after elapsedMs, in Q16 position units
+int64_t profile_distance_q(uint32_t elapsedMs)
+{
+    if (actControl.timedMs != 0)
+    {
+        return eased_distance_q(elapsedMs);
+    }
+
+    const int64_t A = MAX_ACCELERATION;
+    const int64_t V = MAX_VELOCITY;
+    const int64_t ta = actControl.accelMs;
+    const int64_t tc = actControl.cruiseMs;
+    const int64_t totalMs = 2 * ta + tc;
+    const int64_t t = elapsedMs;
 
-// Use this function to implement the rollout order
-void init_rollout_groups(void)
+    // d = A * t^2 / 2, with t in ms
+    if (t < ta)
+    {
+        return ((A * t * t) << PROFILE_Q_BITS) / (2 * US_PER_S);
+    }
+
+    if (t < ta + tc)
+    {
+        return (((A * ta * ta) << PROFILE_Q_BITS) / (2 * US_PER_S)) + (((V * (t - ta)) << PROFILE_Q_BITS) / MS_PER_S);
+    }
+
+    if (t < totalMs)
+    {
+        const int64_t remaining = totalMs - t;
+        return ((int64_t)actControl.maxDelta << PROFILE_Q_BITS) - (((A * remaining * remaining) << PROFILE_Q_BITS) / (2 * US_PER_S));
+    }
+
+    return (int64_t)actControl.maxDelta << PROFILE_Q_BITS;
+}
+
+/**
+ * While in an animated mode the animation engine generates the course, one frame per pass, straight into
+ * the current positions. Posted desired positions are kept, and once the animation ends a transition takes
+ * the course from wherever the animation left it to them.
+ */
+bool run_animation(void)
 {
-    // Currently the groups are the same as the HW groups. This can change.
+    const bool animated = (actControl.mode == WAVE || actControl.mode == TSUNAMI);
+
+    if (!animated)
+    {
+        if (actControl.animMode != STATIC)
+        {
+            actControl.animMode = STATIC;
+            actControl.newTarget = true;
+        }
+        return false;
+    }
+
+    if (actControl.animMode != actControl.mode)
+    {
+        actControl.animMode = actControl.mode;
+        ANIM_start((actControl.mode == WAVE) ? ANIM_WAVE : ANIM_TSUNAMI);
+    }
+
+    uint8_t frame[NUM_ACTUATORS];
+    ANIM_render(frame);
+
     for (uint8_t i = 0; i < NUM_ACTUATORS; i++)
     {
-        uint8_t group = i / NUM_MEMBERS_PER_RO_GROUP;
-        uint8_t member = i % NUM_MEMBERS_PER_RO_GROUP;
-        rolloutGroups[group][member] = i;
+        actControl.currentPos[i] = (frame[i] > MAX_SERVO_POSITION) ? MAX_SERVO_POSITION : frame[i];
     }
+
+    actControl.inTransition = false;
+    return true;
 }
 
-// Based on the current and desired positions, the new current position is updated.
+// Sample the transition at the elapsed time, the new current positions are updated.
 bool calculate_next_position(void)
 {
-    bool didPositionChange = false;
+    if (run_animation())
+    {
+        return true;
+    }
+
+    if (actControl.newTarget)
+    {
+        actControl.newTarget = false;
+        plan_transition();
+    }
+
+    if (!actControl.inTransition)
+    {
+        return false;
+    }
+
+    const uint32_t elapsedMs = TIMER_get_ms(actControl.transitionStart);
+    int64_t distanceQ = profile_distance_q(elapsedMs);
+    const int64_t maxDistanceQ = (int64_t)actControl.maxDelta << PROFILE_Q_BITS;
+
+    if (distanceQ >= maxDistanceQ)
+    {
+        // arrived, land exactly on the targets
+        memcpy(actControl.currentPos, actControl.desiredPos, NUM_ACTUATORS);
+        actControl.inTransition = false;
+        return true;
+    }
+
+    if (distanceQ < 0)
+    {
+        distanceQ = 0;
+    }
 
     for (uint8_t i = 0; i < NUM_ACTUATORS; i++)
     {
-        int deltaTotal = actControl.desiredPos[i] - actControl.currentPos[i];
-        
-        if (deltaTotal != 0)
-        {
-            didPositionChange = true;
-            int step = (abs(deltaTotal) < STEP_MAGNITUDE) ? deltaTotal : (deltaTotal / abs(deltaTotal)) * STEP_MAGNITUDE;
-            
-            actControl.currentPos[i] += step;
-        }
+        const int64_t delta = actControl.desiredPos[i] - actControl.startPos[i];
+
+        // start + delta * (distance / maxDelta), rounded to the nearest position
+        const int64_t offsetQ = (delta * distanceQ) / actControl.maxDelta;
+        actControl.currentPos[i] = actControl.startPos[i] + ((offsetQ + (1 << (PROFILE_Q_BITS - 1))) >> PROFILE_Q_BITS);
     }
 
-    return didPositionChange;
+    return true;
 }
 
-// Based on the rollout groups, physically rollout the changes
-void rollout_actuator_positions(void)
+/**
+ * Mark the actuators whose current position has drifted out of the deadband of what was last sent,
+ * as many of them as fit under the current budget.
+ * 
+ * Servos are packed first fit, starting from where the budget ran out last pass so no servo is starved.
+ * The first servo of a pass is always sent even if it alone is over the budget, otherwise it could never move.
+ */
+bool update_dirty_actuators(void)
 {
-    // iterate through each member of each rollout group
-    for (uint8_t group = 0; group < NUM_ROLLOUT_GROUPS; group++)
+    uint32_t budgetUsedMa = 0;
+    bool anySent = false;
+    bool anyDeferred = false;
+
+    for (uint8_t n = 0; n < NUM_ACTUATORS; n++)
     {
-        for (uint8_t member = 0; member < NUM_MEMBERS_PER_RO_GROUP; member++)
+        uint8_t i = actControl.scheduleStart + n;
+        if (i >= NUM_ACTUATORS)
+        {
+            i -= NUM_ACTUATORS;
+        }
+
+        const int step = actControl.currentPos[i] - actControl.sentPos[i];
+
+        if (step == 0)
+        {
+            continue;
+        }
+
+        if (abs(step) <= POSITION_DEADBAND && actControl.currentPos[i] != actControl.desiredPos[i])
         {
-            // first, find the absolute servo ID
-            uint8_t absoluteServoId = rolloutGroups[group][member];
-            
-            // calculate the relative servo ID and apply the offset
-            uint8_t relativeServoId = (absoluteServoId % NUM_SERVOS_PER_HW_GROUP) + REL_SERVO_ID_OFFSET;
-            
-            // calculate the hw group
-            uint8_t hwGroup = absoluteServoId / NUM_SERVOS_PER_HW_GROUP;
-
-            // rollout!
-            PCA9685_setServoPos(&hwGroups[hwGroup], relativeServoId, actControl.currentPos[absoluteServoId]);
+            continue;
         }
 
-        vTaskDelay(ROLLOUT_GROUP_DELAY_MS / portTICK_PERIOD_MS);
+        const uint32_t demandMa = estimate_move_current_ma(i, step);
+
+        if (anySent && (budgetUsedMa + demandMa) > actControl.currentBudgetMa)
+        {
+            if (!anyDeferred)
+            {
+                actControl.scheduleStart = i;
+                anyDeferred = true;
+            }
+            continue;
+        }
+
+        budgetUsedMa += demandMa;
+        anySent = true;
+
+        const ServoMap_t* map = &servoMap[i];
+
+        actControl.hwGroupPos[map->hwGroup][map->channel] = actControl.currentPos[i];
+        actControl.hwGroupDirty[map->hwGroup] |= (1 << map->channel);
+        actControl.sentPos[i] = actControl.currentPos[i];
+    }
+
+    bool anyDirty = false;
+    for (uint8_t i = 0; i < NUM_HW_GROUPS; i++)
+    {
+        anyDirty |= (actControl.hwGroupDirty[i] != 0);
     }
+
+    return anyDirty;
 }
 
+// Queue the new positions, the output task rolls them out to the boards
+void rollout_actuator_positions(void)
+{
+    for (uint8_t i = 0; i < NUM_HW_GROUPS; i++)
+    {
+        submit_hw_group(i);
+    }
+}
+
+
+/**
+ * Flatten the whole course at once. Every board gets the same position on outputs 1-15, so instead
+ * of stepping 45 servos this is a single All Call broadcast.
+ */
+void reset_course(void)
+{
+    // nothing has changed yet if the queue is full, try again next pass
+    if (!AO_submit_broadcast(STARTING_SERVO_POSITION))
+    {
+        return;
+    }
+
+    memset(actControl.currentPos, STARTING_SERVO_POSITION, NUM_ACTUATORS);
+    memset(actControl.desiredPos, STARTING_SERVO_POSITION, NUM_ACTUATORS);
+    memset(actControl.sentPos, STARTING_SERVO_POSITION, NUM_ACTUATORS);
+
+    for (uint8_t i = 0; i < NUM_ACTUATORS; i++)
+    {
+        actControl.hwGroupPos[servoMap[i].hwGroup][servoMap[i].channel] = STARTING_SERVO_POSITION;
+    }
+
+    // the broadcast replaces anything still pending in the output task as well
+    memset(actControl.hwGroupDirty, 0, sizeof(actControl.hwGroupDirty));
+
+    actControl.resetPending = false;
+    actControl.inTransition = false;
+    actControl.newTarget = false;
+    actControl.animMode = STATIC;
+    actControl.mode = STATIC;
+    actControl.saveCourseState = true;
+}
 
 // Init everything to do with actuator control
 void AC_init(void)
 {
-    init_rollout_groups();
+    init_servo_map();
+    init_current_model();
 
     actControl.mode = STATIC;
     actControl.saveCourseState = false;
+    actControl.resetPending = false;
+    actControl.inTransition = false;
+    actControl.newTarget = false;
+    actControl.targetMs = 0;
+    actControl.targetEasing = EASE_LINEAR;
+    actControl.animMode = STATIC;
     
     esp_err_t nvs_err = NVS_read_course_state(actControl.currentPos);
 
@@ -164,58 +600,61 @@ void AC_init(void)
 
     // set desired and current positions to known state
 
+    ANIM_init();
+
     // init the PCA9685 chips for each hw group
-    for (uint8_t i = 0; i < NUM_HW_GROUPS; i++)
+    AO_init();
+
+    // force all motors to a default, known position, one burst per HW group
+    for (uint8_t i = 0; i < NUM_ACTUATORS; i++)
     {
-        PCA9685_init(&hwGroups[i]);
+        actControl.hwGroupPos[servoMap[i].hwGroup][servoMap[i].channel] = actControl.currentPos[i];
     }
 
-    // force all motors to a default, known position, respecting the rollout groups
-    for (uint8_t group = 0; group < NUM_ROLLOUT_GROUPS; group++)
+    // the output task isn't running yet, so write straight to the boards
+    const uint16_t allServos = ((1 << NUM_SERVOS_PER_HW_GROUP) - 1) << REL_SERVO_ID_OFFSET;
+    for (uint8_t i = 0; i < NUM_HW_GROUPS; i++)
     {
-        for (uint8_t member = 0; member < NUM_MEMBERS_PER_RO_GROUP; member++)
-        {
-            // between 0-44, actual position of the motor on the course
-            uint8_t absoluteServoId = rolloutGroups[group][member];
-            
-            uint8_t relativeServoId = (absoluteServoId % NUM_SERVOS_PER_HW_GROUP) + REL_SERVO_ID_OFFSET;
-            uint8_t hwGroup = absoluteServoId / NUM_SERVOS_PER_HW_GROUP;
-
-            PCA9685_setServoPos(&hwGroups[hwGroup], relativeServoId, actControl.currentPos[absoluteServoId]);
-        }
+        AO_write_frame_blocking(i, actControl.hwGroupPos[i], allServos);
+        actControl.hwGroupDirty[i] = 0;
     }
+
+    memcpy(actControl.sentPos, actControl.currentPos, NUM_ACTUATORS);
 }
 
 void AC_run_task(void)
 {
+    if (actControl.resetPending)
+    {
+        reset_course();
+    }
+
     if (actControl.saveCourseState)
     {
         /**
-         * Saving the desired state with the assumption that the current state will eventually reach the
-         * desired state in this power cycle.
-         * 
-         * We need to do this bec there is currently no logic to figure out when we are "done" moving the 
-         * motors to the most recently changed desired state.
+         * Hand the desired state over to be saved, it is only written to flash once the course has settled.
+         * This never touches flash itself, the write happens outside the control loop in NVS_run_task.
          */
-        NVS_write_course_state(actControl.desiredPos);
+        NVS_request_course_state_save(actControl.desiredPos);
         actControl.saveCourseState = false;
     }
 
-    // calculate next positions based on current and desired position
-    bool didPositionsChange = calculate_next_position();
+    // sample the transition in progress at the current time
+    calculate_next_position();
 
-    // don't run anything else if the new positions are the same as the old positions
-    if (didPositionsChange)
+    // size this pass's budget from the supply rail
+    update_current_budget();
+
+    // don't run anything else if no servo has moved far enough from what it was last sent
+    if (update_dirty_actuators())
     {
         //execute rollout of the new positions
         rollout_actuator_positions();
     }
-
-    // delay
-    vTaskDelay(AC_TASK_DELAY / portTICK_PERIOD_MS);
 }
 
-void AC_update_desired_positions(uint8_t desiredPos[NUM_ACTUATORS])
+// Clamp and take the new desired positions, a new transition is planned on the next pass
+void set_desired_positions(const uint8_t desiredPos[NUM_ACTUATORS])
 {
     for (uint8_t i = 0; i < NUM_ACTUATORS; i++)
     {
@@ -229,10 +668,36 @@ void AC_update_desired_positions(uint8_t desiredPos[NUM_ACTUATORS])
         }
     }
     
+    actControl.newTarget = true;
+}
+
+void AC_update_desired_positions(uint8_t desiredPos[NUM_ACTUATORS])
+{
+    actControl.targetMs = 0;
+    set_desired_positions(desiredPos);
+
     actControl.saveCourseState = true;
 }
 
+void AC_update_desired_positions_timed(const uint8_t desiredPos[NUM_ACTUATORS], uint32_t durationMs, ACEasing_e easing)
+{
+    actControl.targetMs = durationMs;
+    actControl.targetEasing = (easing < NUM_EASINGS) ? easing : EASE_LINEAR;
+    set_desired_positions(desiredPos);
+}
+
+bool AC_is_settled(void)
+{
+    return !actControl.resetPending && !actControl.newTarget && !actControl.inTransition && actControl.animMode == STATIC;
+}
+
 void AC_update_mode(ACMode_e mode)
 {
+    if (mode == RESET)
+    {
+        actControl.resetPending = true;
+        return;
+    }
+
     actControl.mode = mode;
 }
\ No newline at end of file
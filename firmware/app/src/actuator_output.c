@@ -0,0 +1,270 @@
+#include "actuator_output.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include <string.h>
+
+#include "esp_log.h"
+#include "mem_report.h"
+
+#define TAG "ACTUATOR_OUTPUT.C"
+
+/**
+ * Bounded so a burst of course changes can't eat the heap. When it is full the motion planner keeps
+ * its dirty bits and offers the frame again on its next pass, by which point it holds newer positions.
+ */
+#define FRAME_QUEUE_LENGTH          (2 * NUM_HW_GROUPS)
+
+/**
+ * With the phase stagger on, the pulses of the 45 course servos are spread evenly over the PWM period
+ * instead of all starting on tick 0, so far fewer servos are driven at the same instant. How many servos
+ * are moved at once is limited by the current budget in actuator control, not here.
+ */
+#define PHASE_STAGGER_ENABLED       1
+
+#define RETRY_DELAY_MS              50  // how long to wait before re-sending a frame the board didn't acknowledge
+
+/**
+ * Outputs of each board driving course servos. Output 0 of two of the boards drives a ball dispenser, so
+ * a broadcast is a burst over outputs 1-15 rather than an ALL_LED write, and output 0 is never staggered.
+ */
+#define COURSE_FIRST_PIN            1
+#define COURSE_NUM_PINS             (PCA9685_NUM_CHANNELS - COURSE_FIRST_PIN)
+#define COURSE_MASK                 (((1 << COURSE_NUM_PINS) - 1) << COURSE_FIRST_PIN)
+#define NUM_COURSE_OUTPUTS          (NUM_HW_GROUPS * COURSE_NUM_PINS)
+#define BROADCAST_HW_GROUP          NUM_HW_GROUPS   // frame.hwGroup of a broadcast frame
+
+// A frame for one HW group (or every HW group, for a broadcast), as passed through the queue
+typedef struct {
+    uint8_t hwGroup;
+    uint16_t dirtyMask;
+    uint8_t framePos[PCA9685_NUM_CHANNELS];
+} Frame_t;
+
+// struct describing the output task
+typedef struct {
+    QueueHandle_t frameQueue;
+    StaticQueue_t frameQueueBuffer;
+    uint8_t frameQueueStorage[FRAME_QUEUE_LENGTH * sizeof(Frame_t)];
+
+    uint8_t framePos[NUM_HW_GROUPS][PCA9685_NUM_CHANNELS];  // latest positions received for each board
+    uint16_t pendingDirty[NUM_HW_GROUPS];                     // outputs received but not yet acknowledged by the board
+
+    bool pendingBroadcast;          // a broadcast was received but not yet acknowledged
+    uint8_t broadcastPos;
+} ActOutput_t;
+ActOutput_t actOutput;
+
+/**
+ * HW group array holding the PCA9685 instances. Only the output task talks to these once it is running.
+ * 
+ * hwGroups[0] -> 0-14  Absolute Servo ID
+ * hwGroups[1] -> 15-29 Absolute Servo ID
+ * hwGroups[2] -> 30-44 Absolute Servo ID
+ * 
+ */ 
+PCA9685_t hwGroups[NUM_HW_GROUPS] = {
+    { .addr = 0x43, .isLed = false, .osc_freq = 26434765, .priority = I2C_PRIORITY_BULK },
+    { .addr = 0x61, .isLed = false, .osc_freq = 26484736, .priority = I2C_PRIORITY_BULK },
+    { .addr = 0x62, .isLed = false, .osc_freq = 26484736, .priority = I2C_PRIORITY_BULK },
+};
+
+// Send whatever is pending for a HW group, returns true if the board acknowledged it
+bool write_pending(uint8_t hwGroup)
+{
+    // one burst per board, so the whole frame switches on the same PWM edge
+    esp_err_t err = PCA9685_commitServoFrame(&hwGroups[hwGroup], actOutput.framePos[hwGroup], actOutput.pendingDirty[hwGroup]);
+
+    if (err != ESP_OK)
+    {
+        // keep it pending, the whole frame goes out again on the retry
+        ESP_LOGE(TAG, "Failed to write frame to HW group %d w/ error code (%d)", hwGroup, err);
+        return false;
+    }
+
+    actOutput.pendingDirty[hwGroup] = 0;
+    return true;
+}
+
+/**
+ * Send the pending broadcast to every board at once, returns true if it was acknowledged.
+ *
+ * Every board latches the first board's ON ticks, so the outputs the broadcast left with a different
+ * stagger (their shadows are invalidated) are made pending again and rewritten with their own.
+ */
+bool write_broadcast(void)
+{
+    uint8_t pos[COURSE_NUM_PINS];
+    memset(pos, actOutput.broadcastPos, sizeof(pos));
+
+    esp_err_t err = PCA9685_broadcastServoPosRange(hwGroups, NUM_HW_GROUPS, COURSE_FIRST_PIN, COURSE_NUM_PINS, pos);
+
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to write broadcast w/ error code (%d)", err);
+        return false;
+    }
+
+    for (uint8_t i = 0; i < NUM_HW_GROUPS; i++)
+    {
+        for (uint8_t ch = COURSE_FIRST_PIN; ch < PCA9685_NUM_CHANNELS; ch++)
+        {
+            if (hwGroups[i].offShadow[ch] == PCA9685_SHADOW_INVALID)
+            {
+                actOutput.pendingDirty[i] |= (1 << ch);
+            }
+        }
+    }
+
+    actOutput.pendingBroadcast = false;
+    return true;
+}
+
+// Fold a received frame into what is pending, newer positions always win
+void merge_frame(const Frame_t* frame)
+{
+    if (frame->hwGroup == BROADCAST_HW_GROUP)
+    {
+        // the broadcast supersedes anything still pending for its outputs
+        for (uint8_t i = 0; i < NUM_HW_GROUPS; i++)
+        {
+            memset(&actOutput.framePos[i][COURSE_FIRST_PIN], frame->framePos[COURSE_FIRST_PIN], COURSE_NUM_PINS);
+            actOutput.pendingDirty[i] &= ~COURSE_MASK;
+        }
+
+        actOutput.broadcastPos = frame->framePos[COURSE_FIRST_PIN];
+        actOutput.pendingBroadcast = true;
+        return;
+    }
+
+    // the dirty bits accumulate until the board acknowledges them
+    memcpy(actOutput.framePos[frame->hwGroup], frame->framePos, PCA9685_NUM_CHANNELS);
+    actOutput.pendingDirty[frame->hwGroup] |= frame->dirtyMask;
+}
+
+/**
+ * Give every course output its own slice of the PWM period. Slots are interleaved across the boards,
+ * so consecutive slots are on different chips: board g output c gets slot (c - 1) * 3 + g.
+ *
+ * A broadcast uses the ON ticks of the first board for all of them, write_broadcast has the other boards'
+ * outputs rewritten right after it so they get their own back.
+ */
+void stagger_hw_group(uint8_t hwGroup)
+{
+    uint16_t onTick[PCA9685_NUM_CHANNELS] = {0};
+
+#if PHASE_STAGGER_ENABLED
+    for (uint8_t ch = COURSE_FIRST_PIN; ch < PCA9685_NUM_CHANNELS; ch++)
+    {
+        const uint32_t slot = (ch - COURSE_FIRST_PIN) * NUM_HW_GROUPS + hwGroup;
+        onTick[ch] = (slot * PCA9685_NUM_TICKS) / NUM_COURSE_OUTPUTS;
+    }
+#endif
+
+    PCA9685_setOnTicks(&hwGroups[hwGroup], onTick);
+}
+
+void AO_init(void)
+{
+    actOutput.frameQueue = xQueueCreateStatic(FRAME_QUEUE_LENGTH, sizeof(Frame_t), actOutput.frameQueueStorage, &actOutput.frameQueueBuffer);
+    MEM_count_static(MEM_MOD_ACTUATOR_OUTPUT, sizeof(actOutput.frameQueueStorage) + sizeof(actOutput.frameQueueBuffer));
+
+    memset(actOutput.framePos, 0, sizeof(actOutput.framePos));
+    memset(actOutput.pendingDirty, 0, sizeof(actOutput.pendingDirty));
+    actOutput.pendingBroadcast = false;
+
+    // init the PCA9685 chips for each hw group
+    for (uint8_t i = 0; i < NUM_HW_GROUPS; i++)
+    {
+        PCA9685_init(&hwGroups[i]);
+        stagger_hw_group(i);
+    }
+}
+
+esp_err_t AO_write_frame_blocking(uint8_t hwGroup, const uint8_t framePos[PCA9685_NUM_CHANNELS], uint16_t dirtyMask)
+{
+    if (hwGroup >= NUM_HW_GROUPS)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memcpy(actOutput.framePos[hwGroup], framePos, PCA9685_NUM_CHANNELS);
+    actOutput.pendingDirty[hwGroup] |= dirtyMask;
+
+    return write_pending(hwGroup) ? ESP_OK : ESP_FAIL;
+}
+
+bool AO_submit_frame(uint8_t hwGroup, const uint8_t framePos[PCA9685_NUM_CHANNELS], uint16_t dirtyMask)
+{
+    if (hwGroup >= NUM_HW_GROUPS)
+    {
+        return false;
+    }
+
+    Frame_t frame = { .hwGroup = hwGroup, .dirtyMask = dirtyMask };
+    memcpy(frame.framePos, framePos, PCA9685_NUM_CHANNELS);
+
+    return xQueueSend(actOutput.frameQueue, &frame, 0) == pdTRUE;
+}
+
+Timer_t AO_get_frame_applied(uint8_t hwGroup)
+{
+    return (hwGroup < NUM_HW_GROUPS) ? hwGroups[hwGroup].frameApplied : 0;
+}
+
+const PCA9685_t* AO_get_hw_group(uint8_t hwGroup)
+{
+    return (hwGroup < NUM_HW_GROUPS) ? &hwGroups[hwGroup] : NULL;
+}
+
+bool AO_submit_broadcast(uint8_t servoPos)
+{
+    Frame_t frame = { .hwGroup = BROADCAST_HW_GROUP, .dirtyMask = COURSE_MASK };
+    memset(frame.framePos, servoPos, PCA9685_NUM_CHANNELS);
+
+    return xQueueSend(actOutput.frameQueue, &frame, 0) == pdTRUE;
+}
+
+void AO_run_task(void)
+{
+    bool anyPending = actOutput.pendingBroadcast;
+    for (uint8_t i = 0; i < NUM_HW_GROUPS; i++)
+    {
+        anyPending |= (actOutput.pendingDirty[i] != 0);
+    }
+
+    // sleep until there is something to send, unless a failed frame is waiting to be retried
+    const TickType_t waitTicks = anyPending ? pdMS_TO_TICKS(RETRY_DELAY_MS) : portMAX_DELAY;
+
+    Frame_t frame = { .hwGroup = BROADCAST_HW_GROUP };
+    if (xQueueReceive(actOutput.frameQueue, &frame, waitTicks) == pdTRUE)
+    {
+        merge_frame(&frame);
+    }
+
+    /**
+     * A broadcast is older than anything pending for its outputs, so it has to be acknowledged first,
+     * otherwise retrying it later would overwrite newer positions.
+     */
+    if (actOutput.pendingBroadcast && !write_broadcast())
+    {
+        return;
+    }
+
+    // after a retry timeout or a broadcast, hwGroup is BROADCAST_HW_GROUP and every board is flushed, the restagger included
+    if (frame.hwGroup < NUM_HW_GROUPS)
+    {
+        write_pending(frame.hwGroup);
+    }
+    else
+    {
+        for (uint8_t i = 0; i < NUM_HW_GROUPS; i++)
+        {
+            if (actOutput.pendingDirty[i] != 0)
+            {
+                write_pending(i);
+            }
+        }
+    }
+}
@@ -6,9 +6,19 @@
 #include "driver/gpio.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "delay.h"
+#include <string.h>
 
 #define MUX_SOURCE_MASK     0x07
-#define T_ON_WAIT           (2/portTICK_RATE_MS) //ms
+#define T_ON_WAIT_US        2000    // wait for the mux input to switch, just in case
+
+/**
+ * Every source is read this many times in a row and averaged, then the average goes through an
+ * exponential filter: filtered += (average - filtered) / 2^FILTER_SHIFT
+ */
+#define OVERSAMPLE_COUNT    8
+#define FILTER_SHIFT        2
+#define FILTER_Q_BITS       4       // fraction bits kept in the filter state
 
 static const char *TAG = "ADC";
 
@@ -17,8 +27,32 @@ typedef enum {
     LV_SENSE = 7,
 } ADCSource_e;
 
+typedef enum {
+    SAMPLER_SELECT = 0,     // switch the mux to the next source
+    SAMPLER_SETTLE,         // wait for the mux output to settle
+    SAMPLER_SAMPLE,         // take the whole oversample set
+} SamplerState_e;
+
+// The sources the sampler walks through, in order
+static const ADCSource_e samplerSources[] = { LV_SENSE, BD_SENSE };
+#define NUM_SAMPLER_SOURCES (sizeof(samplerSources) / sizeof(samplerSources[0]))
+
+// struct describing the background sampler
+typedef struct {
+    SamplerState_e state;
+    uint8_t sourceIdx;          // index into samplerSources
+    Timer_t settleTimer;
+
+    uint32_t filteredQ[NUM_SAMPLER_SOURCES];    // filtered readings, FILTER_Q_BITS fraction bits
+    bool valid[NUM_SAMPLER_SOURCES];            // a source has a reading once its first oversample set is done
+    uint32_t readings[NUM_SAMPLER_SOURCES];     // oversample sets filtered in so far
+} ADCSampler_t;
+ADCSampler_t adcSampler;
+
 void setMuxInput(ADCSource_e source);
 uint16_t genericADCRead(void);
+void sampler_update_filter(uint8_t sourceIdx, uint16_t average);
+uint16_t sampler_get_filtered(ADCSource_e source);
 
 
 void setMuxInput(ADCSource_e source)
@@ -29,11 +63,15 @@ void setMuxInput(ADCSource_e source)
     const uint8_t muxA1GpioLevel = (muxGpioMask & 0x02) >> 1;
     const uint8_t muxA2GpioLevel = (muxGpioMask & 0x04) >> 2;
 
+#if ADC_MUX_WIRED
     gpio_set_level(ADC_MUX_A0_GPIO, muxA0GpioLevel);
     gpio_set_level(ADC_MUX_A1_GPIO, muxA1GpioLevel);
     gpio_set_level(ADC_MUX_A2_GPIO, muxA2GpioLevel);
-
-    vTaskDelay(T_ON_WAIT); // wait for input to switch, just in case
+#else
+    (void)muxA0GpioLevel;
+    (void)muxA1GpioLevel;
+    (void)muxA2GpioLevel;
+#endif
 }
 
 uint16_t genericADCRead(void)
@@ -55,6 +93,37 @@ uint16_t genericADCRead(void)
 }
 
 
+void sampler_update_filter(uint8_t sourceIdx, uint16_t average)
+{
+    const uint32_t averageQ = (uint32_t)average << FILTER_Q_BITS;
+
+    adcSampler.readings[sourceIdx]++;
+
+    if (!adcSampler.valid[sourceIdx])
+    {
+        // start the filter at the first reading instead of ramping up from 0
+        adcSampler.filteredQ[sourceIdx] = averageQ;
+        adcSampler.valid[sourceIdx] = true;
+        return;
+    }
+
+    int32_t diff = (int32_t)averageQ - (int32_t)adcSampler.filteredQ[sourceIdx];
+    adcSampler.filteredQ[sourceIdx] += diff / (1 << FILTER_SHIFT);
+}
+
+uint16_t sampler_get_filtered(ADCSource_e source)
+{
+    for (uint8_t i = 0; i < NUM_SAMPLER_SOURCES; i++)
+    {
+        if (samplerSources[i] == source)
+        {
+            return (uint16_t)((adcSampler.filteredQ[i] + (1 << (FILTER_Q_BITS - 1))) >> FILTER_Q_BITS);
+        }
+    }
+
+    return 0;
+}
+
 void ADC_init(void)
 {
     adc_config_t adc_config;
@@ -62,25 +131,77 @@ void ADC_init(void)
     adc_config.mode = ADC_READ_TOUT_MODE;
     adc_config.clk_div = 8; // ADC sample collection clock = 80MHz/clk_div = 10MHz
     
-    setMuxInput(LV_SENSE); // set default input
-    
     ESP_ERROR_CHECK(adc_init(&adc_config));
+
+    memset(&adcSampler, 0, sizeof(adcSampler));
+    adcSampler.state = SAMPLER_SELECT;
 }
 
 /**
- * There is only 1 ADC, we must mux in the input first then read
+ * There is only 1 ADC, so the sources take turns: select the source on the mux, let it settle, then take
+ * OVERSAMPLE_COUNT reads back to back. Nothing here waits, settling is checked again on the next call.
  */
-uint16_t ADC_getLvADCVal(void)
+void ADC_run_task(void)
+{
+    switch (adcSampler.state)
+    {
+        case SAMPLER_SELECT:
+            setMuxInput(samplerSources[adcSampler.sourceIdx]);
+            adcSampler.settleTimer = TIMER_restart();
+
+            if (ADC_MUX_WIRED)
+            {
+                adcSampler.state = SAMPLER_SETTLE;
+                break;
+            }
+
+            // nothing to settle, sample in the same call
+            adcSampler.state = SAMPLER_SAMPLE;
+            /* fall through */
+
+        case SAMPLER_SAMPLE:
+        {
+            uint32_t sampleSum = 0;
+            for (uint8_t i = 0; i < OVERSAMPLE_COUNT; i++)
+            {
+                sampleSum += genericADCRead();
+            }
+            sampler_update_filter(adcSampler.sourceIdx, sampleSum / OVERSAMPLE_COUNT);
+
+            adcSampler.sourceIdx = (adcSampler.sourceIdx + 1) % NUM_SAMPLER_SOURCES;
+            adcSampler.state = SAMPLER_SELECT;
+            break;
+        }
+
+        case SAMPLER_SETTLE:
+            if (TIMER_get_us(adcSampler.settleTimer) >= T_ON_WAIT_US)
+            {
+                adcSampler.state = SAMPLER_SAMPLE;
+            }
+            break;
+
+        default:
+            adcSampler.state = SAMPLER_SELECT;
+            break;
+    }
+}
+
+bool ADC_isLvValid(void)
 {
-    setMuxInput(LV_SENSE);
+    return adcSampler.valid[0]; // LV_SENSE is the first source
+}
 
-    return genericADCRead();
+uint32_t ADC_getLvReadingCount(void)
+{
+    return adcSampler.readings[0];
 }
 
-uint16_t ADC_getBDADCVal(void)
+uint16_t ADC_getLvADCVal(void)
 {
-    setMuxInput(BD_SENSE);
-    
-    return genericADCRead();
+    return sampler_get_filtered(LV_SENSE);
+}
 
+uint16_t ADC_getBDADCVal(void)
+{
+    return sampler_get_filtered(BD_SENSE);
 }
\ No newline at end of file
@@ -0,0 +1,242 @@
+#include "animation.h"
+#include "delay.h"
+
+#include <string.h>
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define TAG "ANIMATION.C"
+
+/**
+ * Phases are in 65536ths of a turn and grid distances in Q16 grid cells, so the phase of a cell is just
+ * its distance divided by the wavelength and wraps for free in a uint16_t.
+ */
+#define PHASE_QUARTER           0x4000
+#define PHASE_HALF              0x8000
+#define DIST_Q_BITS             16
+#define SINE_Q_BITS             15
+#define SINE_TABLE_BITS         6       // entries per quarter turn, as a power of 2
+#define SINE_FRAC_BITS          8       // phase bits interpolated between two entries
+#define SPEED_UNITS_PER_CELL    10      // speed is in tenths of a cell per second
+#define MS_PER_S                1000
+
+// sin() over a quarter turn in Q15, 64 steps plus the end point. The other quarters are mirrored from it.
+static const int16_t sineQuarter[(1 << SINE_TABLE_BITS) + 1] = {
+        0,   804,  1608,  2410,  3212,  4011,  4808,  5602,
+     6393,  7179,  7962,  8739,  9512, 10278, 11039, 11793,
+    12539, 13279, 14010, 14732, 15446, 16151, 16846, 17530,
+    18204, 18868, 19519, 20159, 20787, 21403, 22005, 22594,
+    23170, 23731, 24279, 24811, 25329, 25832, 26319, 26790,
+    27245, 27683, 28105, 28510, 28898, 29268, 29621, 29956,
+    30273, 30571, 30852, 31113, 31356, 31580, 31785, 31971,
+    32137, 32285, 32412, 32521, 32609, 32678, 32728, 32757,
+    32767,
+};
+
+// Defaults, indexed by AnimType_e
+static const AnimParams_t defaultParams[NUM_ANIM_TYPES] = {
+    /* ANIM_WAVE */     { .amplitude = 30, .center = 45, .wavelength = 6, .speed = 30, .direction = 64 },
+    /* ANIM_TSUNAMI */  { .amplitude = 80, .center = 0,  .wavelength = 3, .speed = 40, .direction = 64 },
+};
+
+// struct describing the animation engine
+typedef struct {
+    AnimParams_t params[NUM_ANIM_TYPES];
+    bool paramsChanged;                 // re-project the grid before the next frame
+
+    AnimType_e type;
+    Timer_t startTimer;
+
+    int32_t projQ[NUM_ACTUATORS];       // distance of each cell along the direction of travel, Q16 cells
+    int32_t minProjQ;
+    int32_t maxProjQ;
+} AnimEngine_t;
+AnimEngine_t animEngine;
+
+int32_t anim_sin(uint16_t phase);
+int32_t anim_cos(uint16_t phase);
+void anim_project_grid(void);
+uint8_t anim_clamp_position(int32_t pos);
+void anim_render_wave(const AnimParams_t* params, int64_t travelledQ, uint8_t positions[NUM_ACTUATORS]);
+void anim_render_tsunami(const AnimParams_t* params, int64_t travelledQ, uint8_t positions[NUM_ACTUATORS]);
+
+// sin() of a phase in 65536ths of a turn, Q15, linearly interpolated between the table entries
+int32_t anim_sin(uint16_t phase)
+{
+    uint16_t q = phase & (PHASE_QUARTER - 1);
+
+    // 2nd and 4th quarters run the table backwards
+    if (phase & PHASE_QUARTER)
+    {
+        q = PHASE_QUARTER - q;
+    }
+
+    const uint16_t idx = q >> SINE_FRAC_BITS;
+    const int32_t frac = q & ((1 << SINE_FRAC_BITS) - 1);
+    const int32_t a = sineQuarter[idx];
+    const int32_t b = (idx < (1 << SINE_TABLE_BITS)) ? sineQuarter[idx + 1] : a;
+
+    const int32_t value = a + (((b - a) * frac) >> SINE_FRAC_BITS);
+
+    // 3rd and 4th quarters are negative
+    return (phase & PHASE_HALF) ? -value : value;
+}
+
+int32_t anim_cos(uint16_t phase)
+{
+    return anim_sin(phase + PHASE_QUARTER);
+}
+
+// Distance of every cell along the direction of travel: col * cos(direction) + row * sin(direction)
+void anim_project_grid(void)
+{
+    // cleared before the direction is read, so params set while projecting get another projection
+    animEngine.paramsChanged = false;
+
+    const uint16_t direction = (uint16_t)animEngine.params[animEngine.type].direction << 8;
+    const int32_t cosQ = anim_cos(direction);
+    const int32_t sinQ = anim_sin(direction);
+
+    animEngine.minProjQ = INT32_MAX;
+    animEngine.maxProjQ = INT32_MIN;
+
+    for (uint8_t row = 0; row < ANIM_GRID_ROWS; row++)
+    {
+        for (uint8_t col = 0; col < ANIM_GRID_COLS; col++)
+        {
+            // Q15 -> Q16
+            const int32_t projQ = (col * cosQ + row * sinQ) * (1 << (DIST_Q_BITS - SINE_Q_BITS));
+
+            animEngine.projQ[row * ANIM_GRID_COLS + col] = projQ;
+
+            if (projQ < animEngine.minProjQ) { animEngine.minProjQ = projQ; }
+            if (projQ > animEngine.maxProjQ) { animEngine.maxProjQ = projQ; }
+        }
+    }
+}
+
+uint8_t anim_clamp_position(int32_t pos)
+{
+    if (pos < 0)   { return 0; }
+    if (pos > 255) { return 255; }
+
+    return (uint8_t)pos;
+}
+
+// center + amplitude * sin(distance / wavelength), rolling along the direction of travel
+void anim_render_wave(const AnimParams_t* params, int64_t travelledQ, uint8_t positions[NUM_ACTUATORS])
+{
+    for (uint8_t i = 0; i < NUM_ACTUATORS; i++)
+    {
+        const uint16_t phase = (uint16_t)((animEngine.projQ[i] - travelledQ) / params->wavelength);
+        const int32_t offset = (params->amplitude * anim_sin(phase) + (1 << (SINE_Q_BITS - 1))) >> SINE_Q_BITS;
+
+        positions[i] = anim_clamp_position(params->center + offset);
+    }
+}
+
+/**
+ * One raised cosine crest, wavelength cells wide, sweeping from just before the first cell to just past the
+ * last one along the direction of travel, then starting over. Cells outside the crest sit at the center level.
+ */
+void anim_render_tsunami(const AnimParams_t* params, int64_t travelledQ, uint8_t positions[NUM_ACTUATORS])
+{
+    const int64_t widthQ = (int64_t)params->wavelength << DIST_Q_BITS;
+    const int64_t sweepQ = (animEngine.maxProjQ - animEngine.minProjQ) + 2 * widthQ;
+
+    // leading edge of the crest
+    const int64_t frontQ = animEngine.minProjQ + (travelledQ % sweepQ);
+
+    for (uint8_t i = 0; i < NUM_ACTUATORS; i++)
+    {
+        const int64_t intoCrestQ = animEngine.projQ[i] - (frontQ - widthQ);
+        int32_t offset = 0;
+
+        if (intoCrestQ > 0 && intoCrestQ < widthQ)
+        {
+            // (1 - cos) / 2 over the width of the crest, 0 at both edges and 1 in the middle
+            const uint16_t phase = (uint16_t)((intoCrestQ << DIST_Q_BITS) / widthQ);
+            const int32_t shape = ((1 << SINE_Q_BITS) - anim_cos(phase)) / 2;
+
+            offset = (params->amplitude * shape + (1 << (SINE_Q_BITS - 1))) >> SINE_Q_BITS;
+        }
+
+        positions[i] = anim_clamp_position(params->center + offset);
+    }
+}
+
+void ANIM_init(void)
+{
+    memcpy(animEngine.params, defaultParams, sizeof(animEngine.params));
+    animEngine.type = ANIM_WAVE;
+    animEngine.startTimer = TIMER_restart();
+    anim_project_grid();
+}
+
+void ANIM_set_params(AnimType_e type, const AnimParams_t* params)
+{
+    if (type >= NUM_ANIM_TYPES)
+    {
+        return;
+    }
+
+    AnimParams_t newParams = *params;
+
+    // a zero wavelength would divide by 0
+    if (newParams.wavelength == 0)
+    {
+        newParams.wavelength = 1;
+    }
+
+    // called from the httpd task, the control task renders with these so it only ever sees a whole set
+    taskENTER_CRITICAL();
+    animEngine.params[type] = newParams;
+    animEngine.paramsChanged = true;
+    taskEXIT_CRITICAL();
+}
+
+void ANIM_start(AnimType_e type)
+{
+    if (type >= NUM_ANIM_TYPES)
+    {
+        return;
+    }
+
+    animEngine.type = type;
+    animEngine.startTimer = TIMER_restart();
+    anim_project_grid();
+
+    ESP_LOGI(TAG, "Started animation %d", type);
+}
+
+/**
+ * Frames are sampled from the time since the animation started, not counted, so the motion keeps the
+ * same speed however often (or unevenly) this is called.
+ */
+void ANIM_render(uint8_t positions[NUM_ACTUATORS])
+{
+    if (animEngine.paramsChanged)
+    {
+        anim_project_grid();
+    }
+
+    // a copy, so new params set halfway through a frame wait for the next one
+    taskENTER_CRITICAL();
+    const AnimParams_t paramsCopy = animEngine.params[animEngine.type];
+    taskEXIT_CRITICAL();
+    const AnimParams_t* params = &paramsCopy;
+
+    // distance travelled so far, Q16 cells
+    const int64_t elapsedMs = TIMER_get_ms(animEngine.startTimer);
+    const int64_t travelledQ = ((int64_t)params->speed * elapsedMs << DIST_Q_BITS) / (SPEED_UNITS_PER_CELL * MS_PER_S);
+
+    if (animEngine.type == ANIM_TSUNAMI)
+    {
+        anim_render_tsunami(params, travelledQ, positions);
+    }
+    else
+    {
+        anim_render_wave(params, travelledQ, positions);
+    }
+}
@@ -7,17 +7,28 @@
 #include "delay.h"
 #include "ball_queue.h"
 #include "error_codes.h"
+#include "profiler.h"
 #include "esp_log.h"
+#include "freertos/FreeRTOS.h"
 
 #define TAG "BALL_ESTIMATION.C"
 
+// overridable so the replay tool (tools/sensor_replay) can be built with other values
+#ifndef IN_TRANSIT_TIMEOUT_MS
 #define IN_TRANSIT_TIMEOUT_MS 5000 // how long we allow the ball to be in transit before we consider it stuck on the field
+#endif
+#ifndef FEED_ERROR_TIMEOUT_MS
 #define FEED_ERROR_TIMEOUT_MS 7000 // how long we give the ball to travel from the hole to the gutter via the ball in hole return mechanism
+#endif
 
+#ifndef BALL_IN_HOLE_REPEAT_TIMEOUT_MS
 #define BALL_IN_HOLE_REPEAT_TIMEOUT_MS 1500
+#endif
 
 #define RETURN_ONE_BALL 1
 
+#define US_PER_MS 1000
+
 typedef struct{
     uint8_t ballsHit;
     uint8_t ballsInHole;
@@ -48,6 +59,9 @@ void in_gutter_state(void);
 
 void stuck_state(void);
 
+TickType_t ticks_until_timeout(void);
+void run_state_machine(void);
+
 
 void idle_state(void)
 {
@@ -73,22 +87,23 @@ void no_estimation_tracking_state(void)
     // else, continue with no estimation tracking
     else
     {
-        if (SNS_get_ball_dep())
+        int64_t edgeUs;
+
+        // every departure is counted, even balls hit in quick succession
+        while (SNS_take(SNS_BALL_DEP, NULL))
         {
             BE.ballsHit++;
-            SNS_clear_ball_dep();
     
             ESP_LOGI(TAG, "Ball departure detected");
         }
     
-        if (SNS_get_ball_in_hole())
+        while (SNS_take(SNS_BALL_IN_HOLE, &edgeUs))
         {
-            SNS_clear_ball_in_hole();
-
-            if (TIMER_get_ms(BE.ballInHoleTimer) > BALL_IN_HOLE_REPEAT_TIMEOUT_MS)
+            // measured between the beam edges, not between when they were noticed
+            if (((edgeUs - BE.ballInHoleTimer) / US_PER_MS) > BALL_IN_HOLE_REPEAT_TIMEOUT_MS)
             {
 
-                BE.ballInHoleTimer = TIMER_restart();
+                BE.ballInHoleTimer = edgeUs;
 
                 BE.ballsInHole++;
         
@@ -131,11 +146,12 @@ void ready_to_hit_on_enter_state(void)
 
 void ready_to_hit_state(void)
 {
-    if (SNS_get_ball_dep())
+    int64_t edgeUs;
+
+    if (SNS_take(SNS_BALL_DEP, &edgeUs))
     {
         BE.ballsHit++;
-        SNS_clear_ball_dep();
-        BE.inTransitTimer = TIMER_restart();
+        BE.inTransitTimer = edgeUs; // from when the ball actually crossed the beam
 
         ESP_LOGI(TAG, "Ball departure detected");
 
@@ -154,10 +170,12 @@ void in_transit_on_enter_state(void)
 
 void in_transit_state(void)
 {
-    if (SNS_get_ball_in_hole())
+    int64_t edgeUs;
+
+    if (SNS_take(SNS_BALL_IN_HOLE, &edgeUs))
     {
         BE.ballsInHole++;
-        SNS_clear_ball_in_hole();
+        ESP_LOGI(TAG, "Ball reached the hole %d ms after departure", (int)((edgeUs - BE.inTransitTimer) / US_PER_MS));
         BE.state = IN_HOLE;
         return;
     }
@@ -198,11 +216,10 @@ void in_gutter_state(void)
      * If the ball came directly from in transit, this will be true immediately since the flag was not cleared
      * If the ball came from in the hole, this will take some time
      */
-    if (SNS_get_ball_in_gutter())
+    if (SNS_take(SNS_BALL_IN_GUTTER, NULL))
     {
         ESP_LOGI(TAG, "Ball in gutter detected");
         
-        SNS_clear_ball_in_gutter();
         BE.state = READY_TO_HIT_on_enter;
         
         return;
@@ -224,7 +241,31 @@ void stuck_state(void)
 }
 
 
-void BE_run_task(void)
+// How long until the current state times out, forever if only a sensor can move it on
+TickType_t ticks_until_timeout(void)
+{
+    int64_t remainingMs;
+
+    switch (BE.state)
+    {
+        case IN_TRANSIT:
+            remainingMs = IN_TRANSIT_TIMEOUT_MS - TIMER_get_ms(BE.inTransitTimer);
+            break;
+        case IN_GUTTER:
+            remainingMs = FEED_ERROR_TIMEOUT_MS - TIMER_get_ms(BE.feedErrorTimer);
+            break;
+        case NO_ESTIMATION_TRACKING:
+        case READY_TO_HIT:
+            return portMAX_DELAY;
+        default:
+            return 0; // IDLE, on_enter and pass through states run straight away
+    }
+
+    // the timeouts are checked with '>', so wake just after
+    return (remainingMs < 0) ? 0 : pdMS_TO_TICKS(remainingMs + 1);
+}
+
+void run_state_machine(void)
 {
     switch (BE.state)
     {
@@ -258,6 +299,27 @@ void BE_run_task(void)
     }
 }
 
+void BE_run_task(void)
+{
+    SnsEvent_t event;
+    BallEstState_e prevState;
+
+    // the event itself doesn't matter, the states read the confirmed flags
+    SNS_wait_event(&event, ticks_until_timeout());
+
+    // timed from the wake up, the wait itself isn't work
+    const Timer_t profTimer = TIMER_restart();
+
+    // step through the on_enter and pass through states straight away instead of one per wake
+    do
+    {
+        prevState = BE.state;
+        run_state_machine();
+    } while (BE.state != prevState);
+
+    PROF_end(PROF_EXEC_BE, profTimer);
+}
+
 void BE_reset_stats(void)
 {
     BE.ballsHit = 0;
@@ -274,7 +336,15 @@ uint8_t BE_get_balls_in_hole(void)
     return BE.ballsInHole;
 }
 
+BallEstState_e BE_get_state(void)
+{
+    return BE.state;
+}
+
 void BE_set_auto_dispense(bool autoDispense)
 {
     BE.autoDispense = autoDispense;
+
+    // the states waiting on this have nothing else to wake them
+    SNS_wake();
 }
\ No newline at end of file
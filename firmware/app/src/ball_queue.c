@@ -11,7 +11,11 @@
 #define TAG "BALL_QUEUE.C"
 
 #define BIH_FEEDFORWARD_DELAY_MS 4000
+
+// overridable so the replay tool (tools/sensor_replay) can be built with other values
+#ifndef PBR_TIMEOUT_MS
 #define PBR_TIMEOUT_MS           1500
+#endif
 
 #define CW_SPEED_PLAYER          68
 #define CW_SPEED_BIH             68
@@ -58,8 +62,9 @@ typedef struct {
 BallQueue_t BQ = {.BIH_return_state    = IDLE, .BIH_request    = false, .BIH_timeout_timer = 0, .BIH_delay_timer = 0, .BIH_current_delay = 0,
                   .player_return_state = IDLE, .player_request = false, .player_ball_count = 0, .PBR_timer = 0};
 
-const PCA9685_t BIH_SERVO    = { .addr = 0x62, .isLed = false, .osc_freq = 26484736.0 };
-const PCA9685_t PLAYER_SERVO = { .addr = 0x43, .isLed = false, .osc_freq = 26434765.0 };
+// Channel 0 of two of the course boards, urgent so a dispenser stop never queues behind course frames
+PCA9685_t BIH_SERVO    = { .addr = 0x62, .isLed = false, .osc_freq = 26484736, .priority = I2C_PRIORITY_URGENT };
+PCA9685_t PLAYER_SERVO = { .addr = 0x43, .isLed = false, .osc_freq = 26434765, .priority = I2C_PRIORITY_URGENT };
 
 
 void start_cont_servo(const PCA9685_t* pca9685, Dir_e dir, ServoPurpose_e purpose)
@@ -181,10 +186,9 @@ void run_player_ball_queue_task(void)
         
         case DISPENSING:
             
-            if (SNS_get_ball_queue())
+            // one per ball, balls leaving back to back are each counted
+            if (SNS_take(SNS_BALL_QUEUE, NULL))
             {
-                // confirms that we have read the signal and are ready for the next
-                SNS_clear_ball_queue();
                 BQ.player_ball_count--;
 
                 BQ.PBR_timer = TIMER_restart();
@@ -224,6 +228,10 @@ void run_player_ball_queue_task(void)
 
 void BQ_init(void)
 {
+    // the chips themselves are initialized by actuator control, only our handles need setting up
+    PCA9685_initHandle(&BIH_SERVO);
+    PCA9685_initHandle(&PLAYER_SERVO);
+
     stop_cont_servo(&BIH_SERVO);
     stop_cont_servo(&PLAYER_SERVO);
 }
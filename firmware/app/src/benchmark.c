@@ -0,0 +1,222 @@
+#include "benchmark.h"
+#include "pca9685.h"
+#include "i2c.h"
+#include "actuator_output.h"
+
+#include <math.h>
+#include "driver/soc.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#define TAG "BENCHMARK.C"
+
+#define CONVERSION_REPEATS      100
+#define CONVERSION_MAX_POS      90      // MAX_SERVO_POSITION in actuator control
+#define SERVOS_PER_COURSE_STEP  45
+
+// The servo conversion as it was before the lookup tables, kept here as the baseline to measure against
+#define LEGACY_MIN_POS          0.0F
+#define LEGACY_MAX_POS          127.0F
+#define LEGACY_MIN_OFF_POS      85.176F
+#define LEGACY_MAX_OFF_POS      542.5875F
+#define LEGACY_GAIN             ((LEGACY_MAX_OFF_POS - LEGACY_MIN_OFF_POS)/(LEGACY_MAX_POS - LEGACY_MIN_POS))
+
+// I2C throughput is measured against a course board, rewriting registers with what they already hold
+#define I2C_BENCH_ADDR          0x61    // course only board, output 0 is not wired to a dispenser
+#define I2C_BENCH_REPEATS       200
+#define I2C_BENCH_SUBADR1_VAL   0xE2    // power on value of SUBADR1, unused since MODE1_SUB1 is never set
+#define I2C_BENCH_HEADER_BYTES  2       // slave address + register address on the wire for every write
+
+// Positions the pulse overlap is reported for, the pulse width (and so the overlap) grows with the position
+#define OVERLAP_NUM_POSITIONS   3
+static const uint8_t overlapPositions[OVERLAP_NUM_POSITIONS] = { 0, CONVERSION_MAX_POS / 2, CONVERSION_MAX_POS };
+
+uint16_t bench_legacy_servo_pos_to_off_tick(uint8_t servoPos);
+void bench_servo_conversion(void);
+void bench_i2c_report(const char* name, uint32_t payloadLen, int64_t elapsedUs);
+void bench_i2c_throughput(void);
+uint8_t bench_pulses_high(uint16_t tick, uint16_t width, bool staggered);
+void bench_pulse_overlap(void);
+
+uint16_t bench_legacy_servo_pos_to_off_tick(uint8_t servoPos)
+{
+    return (uint16_t)round(LEGACY_GAIN * servoPos + LEGACY_MIN_OFF_POS);
+}
+
+/**
+ * Soft float vs lookup table for the position -> OFF tick conversion done for every servo on every course step.
+ * Both variants are run over the full position range and also checked against each other.
+ */
+void bench_servo_conversion(void)
+{
+    PCA9685_t servo = { .addr = 0, .isLed = false, .osc_freq = 0 };
+    PCA9685_initHandle(&servo);
+
+    volatile uint32_t sink = 0; // stops the loops from being optimized away
+    uint32_t mismatches = 0;
+
+    for (uint16_t pos = 0; pos <= CONVERSION_MAX_POS; pos++)
+    {
+        if (bench_legacy_servo_pos_to_off_tick(pos) != PCA9685_servoPosToOffTick(&servo, pos))
+        {
+            mismatches++;
+        }
+    }
+
+    uint32_t start = soc_get_ccount();
+    for (uint16_t rep = 0; rep < CONVERSION_REPEATS; rep++)
+    {
+        for (uint16_t pos = 0; pos <= CONVERSION_MAX_POS; pos++)
+        {
+            sink += bench_legacy_servo_pos_to_off_tick(pos);
+        }
+    }
+    const uint32_t legacyCycles = soc_get_ccount() - start;
+
+    start = soc_get_ccount();
+    for (uint16_t rep = 0; rep < CONVERSION_REPEATS; rep++)
+    {
+        for (uint16_t pos = 0; pos <= CONVERSION_MAX_POS; pos++)
+        {
+            sink += PCA9685_servoPosToOffTick(&servo, pos);
+        }
+    }
+    const uint32_t lutCycles = soc_get_ccount() - start;
+
+    const uint32_t conversions = CONVERSION_REPEATS * (CONVERSION_MAX_POS + 1);
+    const uint32_t legacyPerConv = legacyCycles / conversions;
+    const uint32_t lutPerConv = lutCycles / conversions;
+
+    ESP_LOGI(TAG, "Servo conversion, %u conversions, %u mismatches", conversions, mismatches);
+    ESP_LOGI(TAG, "  soft float: %u cycles total, %u cycles/conversion, %u cycles/course step",
+             legacyCycles, legacyPerConv, legacyPerConv * SERVOS_PER_COURSE_STEP);
+    ESP_LOGI(TAG, "  lookup:     %u cycles total, %u cycles/conversion, %u cycles/course step",
+             lutCycles, lutPerConv, lutPerConv * SERVOS_PER_COURSE_STEP);
+}
+
+void bench_i2c_report(const char* name, uint32_t payloadLen, int64_t elapsedUs)
+{
+    const uint32_t usPerTransaction = elapsedUs / I2C_BENCH_REPEATS;
+    const uint32_t transactionsPerSec = (I2C_BENCH_REPEATS * 1000000LL) / elapsedUs;
+    const uint32_t payloadBytesPerSec = transactionsPerSec * payloadLen;
+    const uint32_t wireBytesPerSec = transactionsPerSec * (payloadLen + I2C_BENCH_HEADER_BYTES);
+
+    ESP_LOGI(TAG, "  %s: %u us/transaction, %u transactions/s, %u payload bytes/s, %u bytes/s on the wire",
+             name, usPerTransaction, transactionsPerSec, payloadBytesPerSec, wireBytesPerSec);
+}
+
+/**
+ * Write throughput of the whole I2C path (bus manager + backend) for a single register, one servo
+ * (4 registers) and a full board frame (16 outputs). Nothing on the board changes, every write puts
+ * back the value the register already holds.
+ */
+void bench_i2c_throughput(void)
+{
+    uint8_t frame[PCA9685_NUM_CHANNELS * PCA9685_LEDX_OFFSET];
+    int64_t start;
+
+    for (uint8_t ch = 0; ch < PCA9685_NUM_CHANNELS; ch++)
+    {
+        const uint8_t reg = PCA9685_LED0_ON_L + (ch * PCA9685_LEDX_OFFSET);
+        if (I2C_readReg(I2C_BENCH_ADDR, reg, &frame[ch * PCA9685_LEDX_OFFSET], PCA9685_LEDX_OFFSET) != ESP_OK)
+        {
+            ESP_LOGE(TAG, "I2C throughput, could not read board 0x%02x, skipped", I2C_BENCH_ADDR);
+            return;
+        }
+    }
+
+    ESP_LOGI(TAG, "I2C throughput, %s backend, %u writes each",
+             I2C_USE_FAST_BACKEND ? "fast" : "driver", I2C_BENCH_REPEATS);
+
+    start = esp_timer_get_time();
+    for (uint16_t rep = 0; rep < I2C_BENCH_REPEATS; rep++)
+    {
+        I2C_writeReg8(I2C_BENCH_ADDR, PCA9685_SUBADR1, I2C_BENCH_SUBADR1_VAL);
+    }
+    bench_i2c_report("single register", 1, esp_timer_get_time() - start);
+
+    start = esp_timer_get_time();
+    for (uint16_t rep = 0; rep < I2C_BENCH_REPEATS; rep++)
+    {
+        I2C_writeReg(I2C_BENCH_ADDR, PCA9685_LED0_ON_L, frame, PCA9685_LEDX_OFFSET);
+    }
+    bench_i2c_report("one servo burst", PCA9685_LEDX_OFFSET, esp_timer_get_time() - start);
+
+    start = esp_timer_get_time();
+    for (uint16_t rep = 0; rep < I2C_BENCH_REPEATS; rep++)
+    {
+        I2C_writeReg(I2C_BENCH_ADDR, PCA9685_LED0_ON_L, frame, sizeof(frame));
+    }
+    bench_i2c_report("full board burst", sizeof(frame), esp_timer_get_time() - start);
+
+    I2CAllocStats_t stats;
+    I2C_get_alloc_stats(&stats);
+    ESP_LOGI(TAG, "  %u command links allocated over %u transactions", stats.linksCreated, stats.transactions);
+}
+
+// How many course servos are inside their pulse at a tick of the PWM period
+uint8_t bench_pulses_high(uint16_t tick, uint16_t width, bool staggered)
+{
+    uint8_t high = 0;
+
+    for (uint8_t g = 0; g < NUM_HW_GROUPS; g++)
+    {
+        const PCA9685_t* pca9685 = AO_get_hw_group(g);
+
+        // output 0 isn't a course servo
+        for (uint8_t ch = 1; ch < PCA9685_NUM_CHANNELS; ch++)
+        {
+            const uint16_t on = staggered ? pca9685->onTick[ch] : 0;
+            const uint16_t sinceOn = (tick - on) & (PCA9685_NUM_TICKS - 1);
+
+            high += (sinceOn < width);
+        }
+    }
+
+    return high;
+}
+
+/**
+ * Peak and average number of course servos pulsed at the same time over one PWM period, with every
+ * servo at the same position, for the ON ticks in use vs every pulse starting on tick 0.
+ */
+void bench_pulse_overlap(void)
+{
+    const PCA9685_t* pca9685 = AO_get_hw_group(0);
+
+    ESP_LOGI(TAG, "Simultaneous servo pulses per PWM period, aligned vs staggered ON ticks");
+
+    for (uint8_t p = 0; p < OVERLAP_NUM_POSITIONS; p++)
+    {
+        const uint16_t width = PCA9685_servoPosToOffTick(pca9685, overlapPositions[p]);
+        uint8_t peak[2] = {0};
+        uint32_t total[2] = {0};
+
+        for (uint16_t tick = 0; tick < PCA9685_NUM_TICKS; tick++)
+        {
+            for (uint8_t staggered = 0; staggered < 2; staggered++)
+            {
+                const uint8_t high = bench_pulses_high(tick, width, staggered);
+
+                total[staggered] += high;
+                if (high > peak[staggered])
+                {
+                    peak[staggered] = high;
+                }
+            }
+        }
+
+        // averages in hundredths of a servo
+        ESP_LOGI(TAG, "  pos %u (%u ticks): aligned peak %u avg %u.%02u, staggered peak %u avg %u.%02u",
+                 overlapPositions[p], width,
+                 peak[0], total[0] / PCA9685_NUM_TICKS, (total[0] * 100 / PCA9685_NUM_TICKS) % 100,
+                 peak[1], total[1] / PCA9685_NUM_TICKS, (total[1] * 100 / PCA9685_NUM_TICKS) % 100);
+    }
+}
+
+void BENCH_run_all(void)
+{
+    bench_servo_conversion();
+    bench_pulse_overlap();
+    bench_i2c_throughput();
+}
@@ -0,0 +1,75 @@
+#include "boot.h"
+
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+
+#define TAG "BOOT.C"
+
+static const char* bootPhaseNames[NUM_BOOT_PHASES] = {
+    [BOOT_APP_MAIN]   = "app_main",
+    [BOOT_I2C]        = "i2c",
+    [BOOT_NVS]        = "nvs",
+    [BOOT_PWM]        = "pwm",
+    [BOOT_TIMELINE]   = "timeline",
+    [BOOT_GPIO]       = "gpio",
+    [BOOT_ADC]        = "adc",
+    [BOOT_BALL_QUEUE] = "ball queue",
+    [BOOT_SENSORS]    = "sensors",
+    [BOOT_TASKS]      = "tasks",
+    [BOOT_WIFI_AP]    = "wifi ap",
+    [BOOT_HTTPD]      = "httpd",
+};
+
+// struct describing the boot timeline
+typedef struct {
+    uint32_t timestampsUs[NUM_BOOT_PHASES];
+    uint8_t numMarked;
+} BootTimeline_t;
+BootTimeline_t bootTimeline = {0};
+
+void boot_log_timeline(void);
+
+void boot_log_timeline(void)
+{
+    ESP_LOGI(TAG, "Boot timeline (us since power on):");
+
+    for (uint8_t i = 0; i < NUM_BOOT_PHASES; i++)
+    {
+        ESP_LOGI(TAG, "  %-10s %u", bootPhaseNames[i], bootTimeline.timestampsUs[i]);
+    }
+}
+
+void BOOT_mark(BootPhase_e phase)
+{
+    bool done = false;
+
+    if (phase >= NUM_BOOT_PHASES)
+    {
+        return;
+    }
+
+    // the WiFi task marks its phases while app_main marks the others
+    taskENTER_CRITICAL();
+    if (bootTimeline.timestampsUs[phase] == 0)
+    {
+        bootTimeline.timestampsUs[phase] = (uint32_t)esp_timer_get_time();
+        bootTimeline.numMarked++;
+        done = (bootTimeline.numMarked == NUM_BOOT_PHASES);
+    }
+    taskEXIT_CRITICAL();
+
+    if (done)
+    {
+        boot_log_timeline();
+    }
+}
+
+void BOOT_get_timeline(uint32_t timestampsUs[NUM_BOOT_PHASES])
+{
+    taskENTER_CRITICAL();
+    memcpy(timestampsUs, bootTimeline.timestampsUs, sizeof(bootTimeline.timestampsUs));
+    taskEXIT_CRITICAL();
+}
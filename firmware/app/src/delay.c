@@ -1,8 +1,6 @@
 #include "delay.h"
 #include "esp_timer.h"
 
-#include <math.h>
-
 #define US_TO_MS 1000
 
 int64_t TIMER_restart()
@@ -12,7 +10,7 @@ int64_t TIMER_restart()
 
 int64_t TIMER_get_ms(Timer_t timer)
 {
-    return round((esp_timer_get_time() - timer) / US_TO_MS);
+    return (esp_timer_get_time() - timer) / US_TO_MS;
 }
 
 int64_t TIMER_get_us(Timer_t timer)
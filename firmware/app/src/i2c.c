@@ -1,6 +1,18 @@
 #include "i2c.h"
 #include "esp_err.h"
 #include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include <string.h>
+#include "esp_system.h"
+#include "mem_report.h"
+
+#if I2C_USE_FAST_BACKEND
+#include "esp_attr.h"
+#include "driver/gpio.h"
+#include "driver/soc.h"
+#include "esp8266/gpio_struct.h"
+#endif
 
 #define I2C_MASTER_SCL_IO           14
 #define I2C_MASTER_SDA_IO           2
@@ -14,8 +26,288 @@
 #define LAST_NACK_VAL               0x2
 #define I2C_CLK_STRETCH_TICK        300 // 300 ticks, Clock stretch is about 210us, you can make changes according to the actual situation.
 
+/**
+ * Bus manager
+ *
+ * Every write is first queued in the request table, then whichever task holds the bus works through
+ * the table, highest priority (then oldest) first, until its own request is done. A task that gets the
+ * bus and finds its request already done just returns. That way the bus is serialized and a waiting
+ * urgent write is always next, without a dedicated bus task.
+ *
+ * While building a transaction, other queued writes to the same slave whose registers directly follow
+ * (or precede) it are merged into one burst. This relies on every slave on the bus auto-incrementing
+ * its register pointer, which the PCA9685s do with MODE1_AI set.
+ *
+ * Each task only ever has one write in flight, so I2C_MAX_PENDING just has to cover the tasks on the bus.
+ */
+#define I2C_MAX_PENDING             8
+
+typedef enum {
+    REQ_FREE = 0,
+    REQ_PENDING,
+    REQ_IN_FLIGHT,
+    REQ_DONE,
+} I2CRequestState_e;
+
+typedef struct {
+    I2CRequestState_e state;
+    I2CPriority_e priority;
+    uint32_t seq;               // arrival order, oldest first within a priority
+    esp_err_t result;
+
+    uint8_t addr;
+    uint8_t regAddr;
+    uint8_t dataLen;
+    uint8_t data[I2C_MAX_WRITE_LEN];
+} I2CRequest_t;
+
+typedef struct {
+    SemaphoreHandle_t busMutex;     // held by the task currently driving the bus
+    StaticSemaphore_t busMutexBuffer;
+    I2CRequest_t requests[I2C_MAX_PENDING];
+    uint32_t nextSeq;
+
+    // one transaction being built, only touched by the bus holder
+    uint8_t txData[I2C_MAX_WRITE_LEN];
+    I2CRequest_t* txMembers[I2C_MAX_PENDING];
+} I2CBus_t;
+I2CBus_t i2cBus;
+
+#define TX_HEADER_SIZE              2   // slave address + register address, sent ahead of the payload
+
+// Cached command links and the static buffers they point at, only touched by the bus holder
+typedef struct {
+    i2c_cmd_handle_t writeLinks[I2C_MAX_WRITE_LEN + 1];    // indexed by payload length
+    i2c_cmd_handle_t readLinks[I2C_MAX_READ_LEN + 1];      // indexed by read length
+
+    uint8_t txFrame[TX_HEADER_SIZE + I2C_MAX_WRITE_LEN];
+    uint8_t rxHeader;
+    uint8_t rxData[I2C_MAX_READ_LEN];
+
+    I2CAllocStats_t stats;
+} I2CLinks_t;
+I2CLinks_t i2cLinks;
+
+void        i2c_count_link_alloc(uint32_t freeHeapBefore);
+i2c_cmd_handle_t i2c_get_write_link(size_t dataLen);
+i2c_cmd_handle_t i2c_get_read_link(size_t dataLen);
+esp_err_t   i2c_write_transaction(uint8_t addr, uint8_t regAddr, uint8_t* data, size_t dataLen);
+esp_err_t   i2c_read_transaction(uint8_t addr, uint8_t regAddr, uint8_t* data, size_t dataLen);
+I2CRequest_t* i2c_claim_request(void);
+bool        i2c_service_one(void);
+
+#if I2C_USE_FAST_BACKEND
+/**
+ * Fast backend
+ *
+ * Bit-bangs the bus straight through the GPIO registers. Both lines are run open drain by hand: the output
+ * latch is held low and a line is pulled low by enabling its driver, released (pulled high by the board
+ * pull-ups) by disabling it. The PCA9685 never stretches the clock, so SCL is not read back.
+ *
+ * Interrupts are only masked for one byte plus its ACK at a time, about 9 us at 1 MHz, and everything
+ * on the bit path lives in IRAM so a flash cache miss can't stall the clock.
+ *
+ * FAST_HALF_PERIOD_CYCLES is the SCL half period in CPU cycles at 160 MHz:
+ * 80 -> 1 MHz (Fast-mode Plus, the PCA9685 maximum), 200 -> 400 kHz (Fast-mode).
+ */
+#define FAST_HALF_PERIOD_CYCLES     80
+#define FAST_SCL_MASK               (1 << I2C_MASTER_SCL_IO)
+#define FAST_SDA_MASK               (1 << I2C_MASTER_SDA_IO)
+#define FAST_NUM_RECOVERY_CLOCKS    9   // enough to walk a slave stuck mid-byte off the bus
+
+#define FAST_SCL_LOW()              (GPIO.enable_w1ts.val = FAST_SCL_MASK)
+#define FAST_SCL_RELEASE()          (GPIO.enable_w1tc.val = FAST_SCL_MASK)
+#define FAST_SDA_LOW()              (GPIO.enable_w1ts.val = FAST_SDA_MASK)
+#define FAST_SDA_RELEASE()          (GPIO.enable_w1tc.val = FAST_SDA_MASK)
+#define FAST_SDA_READ()             ((GPIO.in.val & FAST_SDA_MASK) != 0)
+
+void        fast_bus_init(void);
+void        fast_half_period(void);
+void        fast_start(void);
+void        fast_stop(void);
+bool        fast_write_byte(uint8_t byte);
+uint8_t     fast_read_byte(bool ack);
+esp_err_t   fast_write_transaction(uint8_t addr, uint8_t regAddr, uint8_t* data, size_t dataLen);
+esp_err_t   fast_read_transaction(uint8_t addr, uint8_t regAddr, uint8_t* data, size_t dataLen);
+
+void fast_bus_init(void)
+{
+    gpio_config_t conf;
+    conf.pin_bit_mask = FAST_SCL_MASK | FAST_SDA_MASK;
+    conf.mode = GPIO_MODE_INPUT;
+    conf.pull_up_en = I2C_ENABLE_SDA_PULLUP;
+    conf.pull_down_en = 0;
+    conf.intr_type = GPIO_INTR_DISABLE;
+    ESP_ERROR_CHECK(gpio_config(&conf));
+
+    GPIO.out_w1tc.val = FAST_SCL_MASK | FAST_SDA_MASK;
+    FAST_SDA_RELEASE();
+    FAST_SCL_RELEASE();
+
+    // clock out whatever a slave may still be sending from before a reset, then leave the bus idle
+    for (uint8_t i = 0; i < FAST_NUM_RECOVERY_CLOCKS; i++)
+    {
+        fast_half_period();
+        FAST_SCL_LOW();
+        fast_half_period();
+        FAST_SCL_RELEASE();
+    }
+    fast_stop();
+}
+
+void IRAM_ATTR fast_half_period(void)
+{
+    const uint32_t start = soc_get_ccount();
+    while ((soc_get_ccount() - start) < FAST_HALF_PERIOD_CYCLES);
+}
+
+// SDA falls while SCL is high, leaves SCL low
+void IRAM_ATTR fast_start(void)
+{
+    FAST_SDA_RELEASE();
+    FAST_SCL_RELEASE();
+    fast_half_period();
+    FAST_SDA_LOW();
+    fast_half_period();
+    FAST_SCL_LOW();
+}
+
+// SDA rises while SCL is high, leaves the bus idle
+void IRAM_ATTR fast_stop(void)
+{
+    FAST_SDA_LOW();
+    fast_half_period();
+    FAST_SCL_RELEASE();
+    fast_half_period();
+    FAST_SDA_RELEASE();
+    fast_half_period();
+}
+
+// Returns true if the slave ACKed the byte
+bool IRAM_ATTR fast_write_byte(uint8_t byte)
+{
+    bool ack;
+
+    taskENTER_CRITICAL();
+
+    for (uint8_t mask = 0x80; mask != 0; mask >>= 1)
+    {
+        if (byte & mask)
+        {
+            FAST_SDA_RELEASE();
+        }
+        else
+        {
+            FAST_SDA_LOW();
+        }
+        fast_half_period();
+        FAST_SCL_RELEASE();
+        fast_half_period();
+        FAST_SCL_LOW();
+    }
+
+    FAST_SDA_RELEASE();
+    fast_half_period();
+    FAST_SCL_RELEASE();
+    fast_half_period();
+    ack = !FAST_SDA_READ();
+    FAST_SCL_LOW();
+
+    taskEXIT_CRITICAL();
+
+    return ack;
+}
+
+uint8_t IRAM_ATTR fast_read_byte(bool ack)
+{
+    uint8_t byte = 0;
+
+    taskENTER_CRITICAL();
+
+    FAST_SDA_RELEASE();
+    for (uint8_t i = 0; i < 8; i++)
+    {
+        fast_half_period();
+        FAST_SCL_RELEASE();
+        fast_half_period();
+        byte = (byte << 1) | FAST_SDA_READ();
+        FAST_SCL_LOW();
+    }
+
+    if (ack)
+    {
+        FAST_SDA_LOW();
+    }
+    fast_half_period();
+    FAST_SCL_RELEASE();
+    fast_half_period();
+    FAST_SCL_LOW();
+    FAST_SDA_RELEASE();
+
+    taskEXIT_CRITICAL();
+
+    return byte;
+}
+
+esp_err_t IRAM_ATTR fast_write_transaction(uint8_t addr, uint8_t regAddr, uint8_t* data, size_t dataLen)
+{
+    esp_err_t ret = ESP_OK;
+
+    fast_start();
+
+    if (!fast_write_byte((addr << 1) | WRITE_BIT) || !fast_write_byte(regAddr))
+    {
+        ret = ESP_FAIL;
+    }
+
+    for (size_t i = 0; (ret == ESP_OK) && (i < dataLen); i++)
+    {
+        if (!fast_write_byte(data[i]))
+        {
+            ret = ESP_FAIL;
+        }
+    }
+
+    fast_stop();
+
+    return ret;
+}
+
+esp_err_t IRAM_ATTR fast_read_transaction(uint8_t addr, uint8_t regAddr, uint8_t* data, size_t dataLen)
+{
+    fast_start();
+
+    if (!fast_write_byte((addr << 1) | WRITE_BIT) || !fast_write_byte(regAddr))
+    {
+        fast_stop();
+        return ESP_FAIL;
+    }
+
+    // repeated start
+    fast_start();
+
+    if (!fast_write_byte((addr << 1) | READ_BIT))
+    {
+        fast_stop();
+        return ESP_FAIL;
+    }
+
+    for (size_t i = 0; i < dataLen; i++)
+    {
+        data[i] = fast_read_byte(i < (dataLen - 1));
+    }
+
+    fast_stop();
+
+    return ESP_OK;
+}
+#endif
+
 esp_err_t I2C_master_init(void)
 {
+#if I2C_USE_FAST_BACKEND
+    fast_bus_init();
+#else
     int i2c_master_port = I2C_MASTER_NUM;
     i2c_config_t conf;
     conf.mode = I2C_MODE_MASTER;
@@ -26,48 +318,297 @@ esp_err_t I2C_master_init(void)
     conf.clk_stretch_tick = I2C_CLK_STRETCH_TICK;
     ESP_ERROR_CHECK(i2c_driver_install(i2c_master_port, conf.mode));
     ESP_ERROR_CHECK(i2c_param_config(i2c_master_port, &conf));
+#endif
+
+    memset(&i2cLinks, 0, sizeof(i2cLinks));
+    memset(i2cBus.requests, 0, sizeof(i2cBus.requests));
+    i2cBus.nextSeq = 0;
+    i2cBus.busMutex = xSemaphoreCreateMutexStatic(&i2cBus.busMutexBuffer);
+    MEM_count_static(MEM_MOD_I2C, sizeof(i2cBus.busMutexBuffer));
+
     return ESP_OK;
 }
 
-esp_err_t I2C_readReg(uint8_t addr, uint8_t regAddr, uint8_t* data, size_t dataLen)
+/**
+ * Command links are cached, one per transaction length, instead of being created and deleted for every
+ * transaction. A link only stores pointers to its data, so each one points into the static frames below
+ * and the address, register and payload are copied in before the link is run again. The first use of a
+ * length allocates its link once, after that the path never touches the heap.
+ */
+// The driver allocates the link internally, so its size is the drop in free heap. Other tasks can allocate at the same time, it is an estimate.
+void i2c_count_link_alloc(uint32_t freeHeapBefore)
+{
+    const uint32_t freeHeapAfter = esp_get_free_heap_size();
+
+    MEM_count_heap_alloc(MEM_MOD_I2C, (freeHeapBefore > freeHeapAfter) ? (freeHeapBefore - freeHeapAfter) : 0);
+}
+
+i2c_cmd_handle_t i2c_get_write_link(size_t dataLen)
+{
+    if (i2cLinks.writeLinks[dataLen] == NULL)
+    {
+        const uint32_t freeHeap = esp_get_free_heap_size();
+        i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+        i2c_master_start(cmd);
+        i2c_master_write(cmd, i2cLinks.txFrame, TX_HEADER_SIZE + dataLen, ACK_CHECK_EN);
+        i2c_master_stop(cmd);
+
+        i2cLinks.writeLinks[dataLen] = cmd;
+        i2cLinks.stats.linksCreated++;
+        i2c_count_link_alloc(freeHeap);
+    }
+
+    return i2cLinks.writeLinks[dataLen];
+}
+
+i2c_cmd_handle_t i2c_get_read_link(size_t dataLen)
+{
+    if (i2cLinks.readLinks[dataLen] == NULL)
+    {
+        const uint32_t freeHeap = esp_get_free_heap_size();
+        i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+        i2c_master_start(cmd);
+        i2c_master_write(cmd, &i2cLinks.rxHeader, 1, ACK_CHECK_EN);
+        i2c_master_read(cmd, i2cLinks.rxData, dataLen, LAST_NACK_VAL);
+        i2c_master_stop(cmd);
+
+        i2cLinks.readLinks[dataLen] = cmd;
+        i2cLinks.stats.linksCreated++;
+        i2c_count_link_alloc(freeHeap);
+    }
+
+    return i2cLinks.readLinks[dataLen];
+}
+
+esp_err_t i2c_read_transaction(uint8_t addr, uint8_t regAddr, uint8_t* data, size_t dataLen)
 {
+    if (dataLen == 0 || dataLen > I2C_MAX_READ_LEN)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+#if I2C_USE_FAST_BACKEND
+    i2cLinks.stats.transactions++;
+    return fast_read_transaction(addr, regAddr, data, dataLen);
+#else
     int ret;
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-    i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, addr << 1 | WRITE_BIT, ACK_CHECK_EN);
-    i2c_master_write_byte(cmd, regAddr, ACK_CHECK_EN);
-    i2c_master_stop(cmd);
-    ret = i2c_master_cmd_begin(I2C_MASTER_NUM, cmd, 1000 / portTICK_RATE_MS);
-    i2c_cmd_link_delete(cmd);
+
+    // point the register pointer at regAddr, a write with no payload
+    i2cLinks.txFrame[0] = (addr << 1) | WRITE_BIT;
+    i2cLinks.txFrame[1] = regAddr;
+    ret = i2c_master_cmd_begin(I2C_MASTER_NUM, i2c_get_write_link(0), 1000 / portTICK_RATE_MS);
+    i2cLinks.stats.transactions++;
 
     if (ret != ESP_OK) {
         return ret;
     }
 
-    cmd = i2c_cmd_link_create();
-    i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, addr << 1 | READ_BIT, ACK_CHECK_EN);
-    i2c_master_read(cmd, data, dataLen, LAST_NACK_VAL);
-    i2c_master_stop(cmd);
-    ret = i2c_master_cmd_begin(I2C_MASTER_NUM, cmd, 1000 / portTICK_RATE_MS);
-    i2c_cmd_link_delete(cmd);
+    i2cLinks.rxHeader = (addr << 1) | READ_BIT;
+    ret = i2c_master_cmd_begin(I2C_MASTER_NUM, i2c_get_read_link(dataLen), 1000 / portTICK_RATE_MS);
+    i2cLinks.stats.transactions++;
+
+    memcpy(data, i2cLinks.rxData, dataLen);
 
     return ret;
+#endif
 }
 
-esp_err_t I2C_writeReg(uint8_t addr, uint8_t regAddr, uint8_t* data, size_t dataLen)
+esp_err_t i2c_write_transaction(uint8_t addr, uint8_t regAddr, uint8_t* data, size_t dataLen)
 {
+    i2cLinks.stats.transactions++;
+
+#if I2C_USE_FAST_BACKEND
+    return fast_write_transaction(addr, regAddr, data, dataLen);
+#else
     int ret;
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-    i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, (addr << 1) | WRITE_BIT, ACK_CHECK_EN);
-    i2c_master_write_byte(cmd, regAddr, ACK_CHECK_EN);
-    i2c_master_write(cmd, data, dataLen, ACK_CHECK_EN);
-    i2c_master_stop(cmd);
-    ret = i2c_master_cmd_begin(I2C_MASTER_NUM, cmd, 1000 / portTICK_RATE_MS);
-    i2c_cmd_link_delete(cmd);
+
+    i2cLinks.txFrame[0] = (addr << 1) | WRITE_BIT;
+    i2cLinks.txFrame[1] = regAddr;
+    memcpy(&i2cLinks.txFrame[TX_HEADER_SIZE], data, dataLen);
+
+    ret = i2c_master_cmd_begin(I2C_MASTER_NUM, i2c_get_write_link(dataLen), 1000 / portTICK_RATE_MS);
 
     return ret;
+#endif
+}
+
+// Find a free slot in the request table, NULL if every slot is taken
+I2CRequest_t* i2c_claim_request(void)
+{
+    I2CRequest_t* req = NULL;
+
+    taskENTER_CRITICAL();
+    for (uint8_t i = 0; i < I2C_MAX_PENDING; i++)
+    {
+        if (i2cBus.requests[i].state == REQ_FREE)
+        {
+            req = &i2cBus.requests[i];
+            req->state = REQ_IN_FLIGHT; // reserved, not visible to the bus holder until it is filled in
+            break;
+        }
+    }
+    taskEXIT_CRITICAL();
+
+    return req;
+}
+
+/**
+ * Put the most important pending write on the bus, merged with any pending writes that extend it.
+ * Must be called with the bus mutex held. Returns false if there was nothing to do.
+ */
+bool i2c_service_one(void)
+{
+    I2CRequest_t* head = NULL;
+    uint8_t numMembers = 0;
+    uint8_t firstReg = 0;
+    uint8_t txLen = 0;
+
+    taskENTER_CRITICAL();
+
+    for (uint8_t i = 0; i < I2C_MAX_PENDING; i++)
+    {
+        I2CRequest_t* req = &i2cBus.requests[i];
+        if (req->state != REQ_PENDING)
+        {
+            continue;
+        }
+
+        if (head == NULL || req->priority > head->priority ||
+            (req->priority == head->priority && (int32_t)(req->seq - head->seq) < 0))
+        {
+            head = req;
+        }
+    }
+
+    if (head != NULL)
+    {
+        head->state = REQ_IN_FLIGHT;
+        i2cBus.txMembers[numMembers++] = head;
+
+        firstReg = head->regAddr;
+        txLen = head->dataLen;
+        memcpy(i2cBus.txData, head->data, head->dataLen);
+
+        // keep growing the burst on either end until no pending write to the same slave fits
+        bool grew = true;
+        while (grew)
+        {
+            grew = false;
+
+            for (uint8_t i = 0; i < I2C_MAX_PENDING; i++)
+            {
+                I2CRequest_t* req = &i2cBus.requests[i];
+                if (req->state != REQ_PENDING || req->addr != head->addr || (txLen + req->dataLen) > I2C_MAX_WRITE_LEN)
+                {
+                    continue;
+                }
+
+                if (req->regAddr == (uint8_t)(firstReg + txLen))
+                {
+                    memcpy(&i2cBus.txData[txLen], req->data, req->dataLen);
+                }
+                else if ((uint8_t)(req->regAddr + req->dataLen) == firstReg)
+                {
+                    memmove(&i2cBus.txData[req->dataLen], i2cBus.txData, txLen);
+                    memcpy(i2cBus.txData, req->data, req->dataLen);
+                    firstReg = req->regAddr;
+                }
+                else
+                {
+                    continue;
+                }
+
+                txLen += req->dataLen;
+                req->state = REQ_IN_FLIGHT;
+                i2cBus.txMembers[numMembers++] = req;
+                grew = true;
+            }
+        }
+    }
+
+    taskEXIT_CRITICAL();
+
+    if (head == NULL)
+    {
+        return false;
+    }
+
+    esp_err_t err = i2c_write_transaction(head->addr, firstReg, i2cBus.txData, txLen);
+
+    taskENTER_CRITICAL();
+    for (uint8_t i = 0; i < numMembers; i++)
+    {
+        i2cBus.txMembers[i]->result = err;
+        i2cBus.txMembers[i]->state = REQ_DONE;
+    }
+    taskEXIT_CRITICAL();
+
+    return true;
+}
+
+esp_err_t I2C_readReg(uint8_t addr, uint8_t regAddr, uint8_t* data, size_t dataLen)
+{
+    xSemaphoreTake(i2cBus.busMutex, portMAX_DELAY);
+
+    // queued writes were issued first, let them land before reading back
+    while (i2c_service_one()) {}
+
+    esp_err_t ret = i2c_read_transaction(addr, regAddr, data, dataLen);
+
+    xSemaphoreGive(i2cBus.busMutex);
+
+    return ret;
+}
+
+esp_err_t I2C_writeRegPrio(uint8_t addr, uint8_t regAddr, uint8_t* data, size_t dataLen, I2CPriority_e priority)
+{
+    if (dataLen == 0 || dataLen > I2C_MAX_WRITE_LEN)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    I2CRequest_t* req = i2c_claim_request();
+    while (req == NULL)
+    {
+        // table full, help drain it and try again
+        xSemaphoreTake(i2cBus.busMutex, portMAX_DELAY);
+        i2c_service_one();
+        xSemaphoreGive(i2cBus.busMutex);
+
+        req = i2c_claim_request();
+    }
+
+    req->addr = addr;
+    req->regAddr = regAddr;
+    req->dataLen = dataLen;
+    req->priority = priority;
+    memcpy(req->data, data, dataLen);
+
+    taskENTER_CRITICAL();
+    req->seq = i2cBus.nextSeq++;
+    req->state = REQ_PENDING;
+    taskEXIT_CRITICAL();
+
+    // drive the bus until our write has gone out, possibly as part of someone else's burst
+    xSemaphoreTake(i2cBus.busMutex, portMAX_DELAY);
+    while (req->state != REQ_DONE)
+    {
+        i2c_service_one();
+    }
+    xSemaphoreGive(i2cBus.busMutex);
+
+    esp_err_t ret = req->result;
+
+    taskENTER_CRITICAL();
+    req->state = REQ_FREE;
+    taskEXIT_CRITICAL();
+
+    return ret;
+}
+
+esp_err_t I2C_writeReg(uint8_t addr, uint8_t regAddr, uint8_t* data, size_t dataLen)
+{
+    return I2C_writeRegPrio(addr, regAddr, data, dataLen, I2C_PRIORITY_NORMAL);
 }
 
 esp_err_t I2C_readReg8(uint8_t addr, uint8_t regAddr, uint8_t* data)
@@ -80,4 +621,11 @@ esp_err_t I2C_writeReg8(uint8_t addr, uint8_t regAddr, uint8_t data)
 {
     uint8_t sendData = data;
     return I2C_writeReg(addr, regAddr, &sendData, 1);
+}
+
+void I2C_get_alloc_stats(I2CAllocStats_t* stats)
+{
+    xSemaphoreTake(i2cBus.busMutex, portMAX_DELAY);
+    *stats = i2cLinks.stats;
+    xSemaphoreGive(i2cBus.busMutex);
 }
\ No newline at end of file
@@ -1,78 +1,156 @@
 #include <stdio.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/timers.h"
 #include "esp_system.h"
 #include "esp_spi_flash.h"
 #include "pca9685.h"
 #include "i2c.h"
 #include "wifi_init.h"
 #include "actuator_control.h"
+#include "actuator_output.h"
 #include "sensors.h"
 #include "ball_estimation.h"
 #include "ball_queue.h"
 #include "gpio.h"
 #include "delay.h"
 #include "user_nvs.h"
+#include "benchmark.h"
+#include "adc.h"
+#include "timeline.h"
+#include "boot.h"
+#include "task_monitor.h"
+#include "profiler.h"
+#include "mem_report.h"
 
 #define LED_BLINK_TIMER_MS      500
+#define WIFI_INIT_STACK_SIZE    3584    // what WiFi bring-up had as part of the main task
+#define APP_TASK_STACK_SIZE     2048
 
-static void task_1ms(void* arg);
-static void task_10ms(void* arg);
+#define AC_PERIOD_MS            10
+#define HOUSEKEEPING_PERIOD_MS  100
+
+/**
+ * Task priorities, higher runs first. Sensors come first so no edge is debounced late, then ball estimation
+ * which reacts to them, then motion, then everything that can wait. The sensors are debounced by timers,
+ * so their priority is the one of the timer service task.
+ */
+#define SENSORS_PRIORITY        13
+#define BALL_EST_PRIORITY       12
+#define MOTION_PRIORITY         11      // actuator control and output
+#define HOUSEKEEPING_PRIORITY   6       // ball queue, NVS saves
+#define WIFI_INIT_PRIORITY      5       // below the control tasks, the course never waits on WiFi
+
+static void task_actuator_control(void* arg);
 static void task_100ms(void* arg);
+static void task_actuator_output(void* arg);
+static void task_wifi_init(void* arg);
+static void task_ball_estimation(void* arg);
+static void led_blink_callback(TimerHandle_t timer);
+
+/**
+ * The app tasks run for the whole power cycle, so their stacks and control blocks are static instead of
+ * coming from the heap. The one shot WiFi bring-up task is created dynamically, its memory is given back.
+ */
+static StackType_t ballEstStack[APP_TASK_STACK_SIZE];
+static StackType_t actCtrlStack[APP_TASK_STACK_SIZE];
+static StackType_t actOutStack[APP_TASK_STACK_SIZE];
+static StackType_t task100msStack[APP_TASK_STACK_SIZE];
+static StaticTask_t taskTcbs[NUM_MEM_TASKS];
+static StaticTimer_t ledBlinkTimerBuffer;
 
 void app_main()
 {
+    BOOT_mark(BOOT_APP_MAIN);
+
     /**
      * We are initializing these 3 first becuase we want to init the servo PWMs as fast as possible
      * to avoid stalling the servos and drawing too much current.
      */
     I2C_master_init();
-    NVS_init(); // NVS_init must come before any other init that uses it
+    BOOT_mark(BOOT_I2C);
+    NVS_init(); // NVS_init must come before any other init that uses it, WiFi included
+    BOOT_mark(BOOT_NVS);
     AC_init();
+    BOOT_mark(BOOT_PWM);
+    TL_init();
+    BOOT_mark(BOOT_TIMELINE);
 
-    WIFI_init_and_start_server();
+#if BENCHMARKS_ENABLED
+    BENCH_run_all();
+#endif
+
+    /**
+     * The debounce timers run in the timer service task, it has to preempt everything the sensors used to.
+     * Every other FreeRTOS timer and esp_timer callback (the SDK's included) runs above the control tasks
+     * with it, so those callbacks have to stay short.
+     */
+    vTaskPrioritySet(xTimerGetTimerDaemonTaskHandle(), SENSORS_PRIORITY);
 
     GPIO_init();
+    BOOT_mark(BOOT_GPIO);
+    ADC_init();
+    BOOT_mark(BOOT_ADC);
     BQ_init();
+    BOOT_mark(BOOT_BALL_QUEUE);
     SNS_init();
+    BOOT_mark(BOOT_SENSORS);
+
+    TASKMON_init(TASKMON_ACTUATOR_CONTROL, AC_PERIOD_MS);
+    TASKMON_init(TASKMON_HOUSEKEEPING, HOUSEKEEPING_PERIOD_MS);
+
+    MEM_create_static_task(MEM_TASK_BALL_EST, task_ball_estimation, "task_ball_est", ballEstStack, APP_TASK_STACK_SIZE,
+                           BALL_EST_PRIORITY, &taskTcbs[MEM_TASK_BALL_EST]);
+    MEM_create_static_task(MEM_TASK_ACTUATOR_CONTROL, task_actuator_control, "task_act_ctrl", actCtrlStack, APP_TASK_STACK_SIZE,
+                           MOTION_PRIORITY, &taskTcbs[MEM_TASK_ACTUATOR_CONTROL]);
+    MEM_create_static_task(MEM_TASK_ACTUATOR_OUTPUT, task_actuator_output, "task_act_out", actOutStack, APP_TASK_STACK_SIZE,
+                           MOTION_PRIORITY, &taskTcbs[MEM_TASK_ACTUATOR_OUTPUT]);
+    MEM_create_static_task(MEM_TASK_HOUSEKEEPING, task_100ms, "task_100ms", task100msStack, APP_TASK_STACK_SIZE,
+                           HOUSEKEEPING_PRIORITY, &taskTcbs[MEM_TASK_HOUSEKEEPING]);
+
+    TimerHandle_t ledBlinkTimer = xTimerCreateStatic("led_blink", pdMS_TO_TICKS(LED_BLINK_TIMER_MS), pdTRUE, NULL,
+                                                     led_blink_callback, &ledBlinkTimerBuffer);
+    xTimerStart(ledBlinkTimer, 0);
+    BOOT_mark(BOOT_TASKS);
 
-    xTaskCreate(task_1ms,   "task_1ms",   2048, NULL, 10, NULL);
-    xTaskCreate(task_10ms,  "task_10ms",  2048, NULL, 10, NULL);
-    xTaskCreate(task_100ms, "task_100ms", 2048, NULL, 10, NULL);
+    /**
+     * WiFi and the web server take the longest to come up, nothing else needs them so they come up last, in
+     * a task of their own. It preempts app_main (ESP_TASK_MAIN_PRIO is 1), so it is only created once every
+     * module the HTTP handlers touch is initialized and the control tasks run.
+     */
+    xTaskCreate(task_wifi_init, "task_wifi_init", WIFI_INIT_STACK_SIZE, NULL, WIFI_INIT_PRIORITY, NULL);
 }
 
-static void task_1ms(void* arg)
+// One shot, brings up WiFi and the web server then deletes itself
+static void task_wifi_init(void* arg)
 {
-    TickType_t xLastWakeTime = xTaskGetTickCount(); // Get current tick count
-    const TickType_t xFrequency = pdMS_TO_TICKS(1); // Convert 1ms to ticks
-    
-    Timer_t blink_timer;
-    blink_timer = TIMER_restart();
+    WIFI_init_and_start_server();
 
-    for (;;)
-    {
-        SNS_run_task();
-
-        if (TIMER_get_ms(blink_timer) > LED_BLINK_TIMER_MS)
-        {
-            gpio_set_level(LED_GPIO_OUT, !gpio_get_level(LED_GPIO_OUT)); // Toggle GPIO15
-            blink_timer = TIMER_restart();
-        }
-        
-        vTaskDelayUntil(&xLastWakeTime, xFrequency);
-    }
+    vTaskDelete(NULL);
 }
 
-static void task_10ms(void* arg)
+static void task_actuator_control(void* arg)
 {
     TickType_t xLastWakeTime = xTaskGetTickCount(); // Get current tick count
-    const TickType_t xFrequency = pdMS_TO_TICKS(10); // Convert 10ms to ticks
+    const TickType_t xFrequency = pdMS_TO_TICKS(AC_PERIOD_MS);
 
     for (;;)
     {
+        TASKMON_pass_start(TASKMON_ACTUATOR_CONTROL);
+
+        Timer_t profTimer = TIMER_restart();
+        ADC_run_task(); // the supply reading AC_run_task budgets the current with
+        PROF_end(PROF_EXEC_ADC, profTimer);
+
+        profTimer = TIMER_restart();
+        TL_run_task(); // keyframes are handed to AC_run_task in the same pass they are due
+        PROF_end(PROF_EXEC_TL, profTimer);
+
+        profTimer = TIMER_restart();
         AC_run_task();
-        BE_run_task();
+        PROF_end(PROF_EXEC_AC, profTimer);
 
+        TASKMON_pass_end(TASKMON_ACTUATOR_CONTROL);
         vTaskDelayUntil(&xLastWakeTime, xFrequency);
     }
 }
@@ -80,12 +158,44 @@ static void task_10ms(void* arg)
 static void task_100ms(void* arg)
 {
     TickType_t xLastWakeTime = xTaskGetTickCount(); // Get current tick count
-    const TickType_t xFrequency = pdMS_TO_TICKS(100); // Convert 100ms to ticks
+    const TickType_t xFrequency = pdMS_TO_TICKS(HOUSEKEEPING_PERIOD_MS);
 
     for (;;)
     {
+        TASKMON_pass_start(TASKMON_HOUSEKEEPING);
+
+        Timer_t profTimer = TIMER_restart();
         BQ_run_task();
+        PROF_end(PROF_EXEC_BQ, profTimer);
 
+        profTimer = TIMER_restart();
+        NVS_run_task(); // course state saves happen here, away from the control loop
+        PROF_end(PROF_EXEC_NVS, profTimer);
+
+        TASKMON_pass_end(TASKMON_HOUSEKEEPING);
         vTaskDelayUntil(&xLastWakeTime, xFrequency);
     }
-}
\ No newline at end of file
+}
+
+// Not periodic, AO_run_task blocks until there is a frame to write
+static void task_actuator_output(void* arg)
+{
+    for (;;)
+    {
+        AO_run_task();
+    }
+}
+
+// Not periodic, BE_run_task blocks until a sensor event or a state timeout
+static void task_ball_estimation(void* arg)
+{
+    for (;;)
+    {
+        BE_run_task();
+    }
+}
+
+static void led_blink_callback(TimerHandle_t timer)
+{
+    gpio_set_level(LED_GPIO_OUT, !gpio_get_level(LED_GPIO_OUT)); // Toggle GPIO15
+}
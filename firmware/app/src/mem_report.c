@@ -0,0 +1,101 @@
+#include "mem_report.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include "esp_system.h"
+#include "esp_log.h"
+
+#define TAG "MEM_REPORT.C"
+
+// The largest free block is found to within this many bytes
+#define LARGEST_BLOCK_RESOLUTION    16
+
+// struct describing the memory accounting
+typedef struct {
+    MemModuleStats_t modules[NUM_MEM_MODULES];
+    TaskHandle_t taskHandles[NUM_MEM_TASKS];
+    uint32_t taskStackDepth[NUM_MEM_TASKS];
+} MemAccounting_t;
+MemAccounting_t memAccounting = {0};
+
+uint32_t mem_largest_free_block(void);
+
+/**
+ * The heap allocator has no query for this, so the size is binary searched by allocating and freeing
+ * straight away. Only done when a report is asked for. The scheduler is suspended for the search so
+ * WiFi and lwIP never see the heap with a probe block taking most of it.
+ */
+uint32_t mem_largest_free_block(void)
+{
+    vTaskSuspendAll();
+
+    uint32_t low = 0;
+    uint32_t high = esp_get_free_heap_size();
+
+    while ((high - low) > LARGEST_BLOCK_RESOLUTION)
+    {
+        const uint32_t mid = low + (high - low) / 2;
+        void* block = malloc(mid);
+
+        if (block != NULL)
+        {
+            free(block);
+            low = mid;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+
+    xTaskResumeAll();
+    return low;
+}
+
+void MEM_count_heap_alloc(MemModule_e module, size_t bytes)
+{
+    taskENTER_CRITICAL();
+    memAccounting.modules[module].heapAllocs++;
+    memAccounting.modules[module].heapBytes += bytes;
+    taskEXIT_CRITICAL();
+}
+
+void MEM_count_static(MemModule_e module, size_t bytes)
+{
+    taskENTER_CRITICAL();
+    memAccounting.modules[module].staticBytes += bytes;
+    taskEXIT_CRITICAL();
+}
+
+void MEM_create_static_task(MemTask_e task, TaskFunction_t function, const char* name, StackType_t* stack,
+                            uint32_t stackDepth, UBaseType_t priority, StaticTask_t* tcb)
+{
+    memAccounting.taskHandles[task] = xTaskCreateStatic(function, name, stackDepth, NULL, priority, stack, tcb);
+    memAccounting.taskStackDepth[task] = stackDepth;
+
+    MEM_count_static(MEM_MOD_TASKS, (stackDepth * sizeof(StackType_t)) + sizeof(StaticTask_t));
+}
+
+void MEM_get_report(MemReport_t* report)
+{
+    memset(report, 0, sizeof(MemReport_t));
+
+    report->freeHeap = esp_get_free_heap_size();
+    report->minFreeHeap = esp_get_minimum_free_heap_size();
+    report->largestFreeBlock = mem_largest_free_block();
+
+    for (uint8_t i = 0; i < NUM_MEM_TASKS; i++)
+    {
+        if (memAccounting.taskHandles[i] != NULL)
+        {
+            report->tasks[i].stackDepth = memAccounting.taskStackDepth[i];
+            report->tasks[i].stackHighWater = uxTaskGetStackHighWaterMark(memAccounting.taskHandles[i]);
+        }
+    }
+
+    taskENTER_CRITICAL();
+    memcpy(report->modules, memAccounting.modules, sizeof(report->modules));
+    taskEXIT_CRITICAL();
+
+    ESP_LOGD(TAG, "Free heap %u (min %u, largest block %u)", report->freeHeap, report->minFreeHeap, report->largestFreeBlock);
+}
@@ -1,6 +1,5 @@
 #include "pca9685.h"
 #include "i2c.h"
-#include "math.h"
 
 #define ON_L_OFFSET             0
 #define ON_H_OFFSET             1
@@ -8,11 +7,13 @@
 #define OFF_H_OFFSET            3
 #define ON_OFF_L_MASK           0x00FF
 #define ON_OFF_H_MASK           0x0F00
+#define TICK_MASK               (PCA9685_NUM_TICKS - 1)
 #define SET_PWM_SIZE            4
 #define GET_PWM_SIZE            2
 
-#define MIN_FREQ                24.0F
-#define MAX_FREQ                1526.0F
+#define MIN_FREQ                24
+#define MAX_FREQ                1526
+#define PRESCALE_DIVISOR        4096    // the prescaler counts osc_freq / 4096 ticks per PWM period
 
 #define MIN_POS                 0.0F   // 0% duty
 #define MAX_POS                 127.0F // 100% duty
@@ -25,13 +26,30 @@
 #define MAX_OFF_POS_LED         4095.0F     // 100% duty
 #define GAIN_LED                ((MAX_OFF_POS_LED - MIN_OFF_POS_LED)/(MAX_POS - MIN_POS))
 
-#define TOTAL_NUM_SERVO 15
+/**
+ * The position -> OFF tick lookup tables are built in Q16 fixed point. The float constants above are
+ * only ever folded by the compiler, nothing on the device runs soft float to fill or read the tables.
+ */
+#define LUT_Q_BITS              16
+#define LUT_TO_Q(x)             ((uint32_t)((x) * (1 << LUT_Q_BITS) + 0.5F))
+#define LUT_SIZE                256     // one entry per possible servoPos
 
 void        pca9685_setPrescaler(const PCA9685_t* pca9685, uint8_t prescaler);
 uint8_t     pca9685_getPrescaler(const PCA9685_t* pca9685);
 esp_err_t   pca9685_setPWM(const PCA9685_t* pca9685, uint8_t outputPin, uint16_t onPos, uint16_t offPos);
+void        pca9685_packPWM(uint8_t* data, uint16_t onPos, uint16_t offPos);
+void        pca9685_buildLut(uint16_t* lut, uint32_t minOffQ, uint32_t gainQ);
+uint16_t    pca9685_offTick(const PCA9685_t* pca9685, uint8_t outputPin, uint8_t servoPos);
+void        pca9685_packOffRun(uint8_t* data, const uint16_t* onPos, uint8_t numPins, const uint16_t* offPos);
+esp_err_t   pca9685_writeOffRun(PCA9685_t* pca9685, uint8_t firstPin, uint8_t numPins, const uint16_t* offPos);
 uint16_t    pca9685_getPWM(const PCA9685_t* pca9685, uint8_t outputPin, bool getOff);
 
+// Shared by every handle of the same variant, filled the first time a handle of that variant is initialized
+static uint16_t servoOffLut[LUT_SIZE];
+static uint16_t ledOffLut[LUT_SIZE];
+static bool servoOffLutBuilt = false;
+static bool ledOffLutBuilt = false;
+
 void pca9685_setPrescaler(const PCA9685_t* pca9685, uint8_t prescaler)
 {
     const uint8_t ADDR = pca9685->addr;
@@ -53,19 +71,25 @@ uint8_t pca9685_getPrescaler(const PCA9685_t* pca9685)
     return prescaler;
 }
 
-esp_err_t pca9685_setPWM(const PCA9685_t* pca9685, uint8_t outputPin, uint16_t onPos, uint16_t offPos)
+// packs the ON/OFF ticks of one output into the 4 LEDn register bytes
+void pca9685_packPWM(uint8_t* data, uint16_t onPos, uint16_t offPos)
 {
-    uint8_t regAddr = PCA9685_LED0_ON_L + PCA9685_LEDX_OFFSET * outputPin;
-    
-    uint8_t data[SET_PWM_SIZE] = {0};
-
     data[ON_L_OFFSET] = (uint8_t)( onPos & ON_OFF_L_MASK);
     data[ON_H_OFFSET] = (uint8_t)((onPos & ON_OFF_H_MASK) >> 8);
 
     data[OFF_L_OFFSET] = (uint8_t)( offPos & ON_OFF_L_MASK);
     data[OFF_H_OFFSET] = (uint8_t)((offPos & ON_OFF_H_MASK) >> 8);
+}
+
+esp_err_t pca9685_setPWM(const PCA9685_t* pca9685, uint8_t outputPin, uint16_t onPos, uint16_t offPos)
+{
+    uint8_t regAddr = PCA9685_LED0_ON_L + PCA9685_LEDX_OFFSET * outputPin;
+    
+    uint8_t data[SET_PWM_SIZE] = {0};
+
+    pca9685_packPWM(data, onPos, offPos);
 
-    return I2C_writeReg(pca9685->addr, regAddr, data, SET_PWM_SIZE);
+    return I2C_writeRegPrio(pca9685->addr, regAddr, data, SET_PWM_SIZE, pca9685->priority);
 }
 
 uint16_t pca9685_getPWM(const PCA9685_t* pca9685, uint8_t outputPin, bool getOff)
@@ -80,14 +104,100 @@ uint16_t pca9685_getPWM(const PCA9685_t* pca9685, uint8_t outputPin, bool getOff
 }
 
 
+// fills a position -> OFF tick table for OFF = minOff + gain * pos, both given in Q16
+void pca9685_buildLut(uint16_t* lut, uint32_t minOffQ, uint32_t gainQ)
+{
+    uint32_t offQ = minOffQ;
+
+    for (uint16_t pos = 0; pos < LUT_SIZE; pos++)
+    {
+        lut[pos] = (uint16_t)((offQ + (1 << (LUT_Q_BITS - 1))) >> LUT_Q_BITS); // round to nearest tick
+        offQ += gainQ;
+    }
+}
+
+/**
+ * OFF tick of an output for a position, the pulse width from the lookup table starting at the output's ON tick.
+ * A pulse that runs past the end of the period wraps around, which the chip handles as OFF < ON.
+ */
+uint16_t pca9685_offTick(const PCA9685_t* pca9685, uint8_t outputPin, uint8_t servoPos)
+{
+    return (pca9685->onTick[outputPin] + PCA9685_servoPosToOffTick(pca9685, servoPos)) & TICK_MASK;
+}
+
+// packs the ON/OFF ticks of consecutive outputs
+void pca9685_packOffRun(uint8_t* data, const uint16_t* onPos, uint8_t numPins, const uint16_t* offPos)
+{
+    for (uint8_t i = 0; i < numPins; i++)
+    {
+        pca9685_packPWM(&data[i * SET_PWM_SIZE], onPos[i], offPos[i]);
+    }
+}
+
+/**
+ * Writes the OFF ticks of consecutive outputs in one auto-increment burst and keeps the shadow
+ * registers in sync with what the chip acknowledged.
+ */
+esp_err_t pca9685_writeOffRun(PCA9685_t* pca9685, uint8_t firstPin, uint8_t numPins, const uint16_t* offPos)
+{
+    uint8_t regAddr = PCA9685_LED0_ON_L + PCA9685_LEDX_OFFSET * firstPin;
+
+    uint8_t data[PCA9685_NUM_CHANNELS * SET_PWM_SIZE] = {0};
+
+    pca9685_packOffRun(data, &pca9685->onTick[firstPin], numPins, offPos);
+
+    esp_err_t err = I2C_writeRegPrio(pca9685->addr, regAddr, data, numPins * SET_PWM_SIZE, pca9685->priority);
+
+    for (uint8_t i = 0; i < numPins; i++)
+    {
+        // on failure we don't know what the chip latched, so force a resend next time
+        pca9685->offShadow[firstPin + i] = (err == ESP_OK) ? offPos[i] : PCA9685_SHADOW_INVALID;
+    }
+
+    return err;
+}
+
+// set up the software side of a handle
+void PCA9685_initHandle(PCA9685_t* pca9685)
+{
+    if (pca9685->isLed)
+    {
+        if (!ledOffLutBuilt)
+        {
+            pca9685_buildLut(ledOffLut, LUT_TO_Q(MIN_OFF_POS_LED), LUT_TO_Q(GAIN_LED));
+            ledOffLutBuilt = true;
+        }
+        pca9685->offLut = ledOffLut;
+    }
+    else
+    {
+        if (!servoOffLutBuilt)
+        {
+            pca9685_buildLut(servoOffLut, LUT_TO_Q(MIN_OFF_POS_SERVO), LUT_TO_Q(GAIN_SERVO));
+            servoOffLutBuilt = true;
+        }
+        pca9685->offLut = servoOffLut;
+    }
+
+    for (uint8_t i = 0; i < PCA9685_NUM_CHANNELS; i++)
+    {
+        pca9685->offShadow[i] = PCA9685_SHADOW_INVALID;
+    }
+
+    pca9685->frameApplied = 0;
+    pca9685->framesApplied = 0;
+}
+
 // init
-void PCA9685_init(const PCA9685_t* pca9685)
+void PCA9685_init(PCA9685_t* pca9685)
 {
+    PCA9685_initHandle(pca9685);
+
     //configure the mode 1 and 2
     const uint8_t ADDR = pca9685->addr;
-    uint8_t mode1 = MODE1_AI;
+    uint8_t mode1 = MODE1_AI | MODE1_ALLCAL;   // All Call lets broadcasts reach every board in one transaction
 
-    uint8_t mode2 = MODE2_OUTDRV;
+    uint8_t mode2 = MODE2_OUTDRV;   // MODE2_OCH clear, outputs change on STOP so a burst applies as one frame
     if (pca9685->isLed)
     {
         mode2 = MODE2_INVRT; // may have to change between LED and Servos
@@ -95,48 +205,247 @@ void PCA9685_init(const PCA9685_t* pca9685)
     
     PCA9685_setFreq(pca9685, DEFAULT_SERVO_FREQ);
     
+    I2C_writeReg8(ADDR, PCA9685_ALLCALLADR, PCA9685_ALLCALL_ADDR << 1);
     I2C_writeReg8(ADDR, PCA9685_MODE1, mode1);
     I2C_writeReg8(ADDR, PCA9685_MODE2, mode2);
 }
 
+/**
+ * Staggering the ON ticks of the outputs spreads their pulses over the period, so fewer servos are
+ * pulsed (and draw current) at the same time than when every pulse starts on tick 0.
+ */
+void PCA9685_setOnTicks(PCA9685_t* pca9685, const uint16_t onTick[PCA9685_NUM_CHANNELS])
+{
+    for (uint8_t i = 0; i < PCA9685_NUM_CHANNELS; i++)
+    {
+        pca9685->onTick[i] = onTick[i] & TICK_MASK;
+        pca9685->offShadow[i] = PCA9685_SHADOW_INVALID;
+    }
+}
+
 // set frequency between 24Hz and 1526Hz
-void PCA9685_setFreq(const PCA9685_t* pca9685, float freq)
+void PCA9685_setFreq(const PCA9685_t* pca9685, uint16_t freq)
 {
     if (freq < MIN_FREQ){freq = MIN_FREQ;}
     if (freq > MAX_FREQ){freq = MAX_FREQ;}
 
-    uint8_t prescaler = (uint16_t)(round(pca9685->osc_freq / (4096.0 * freq)) - 1.0);
+    // prescaler = round(osc_freq / (4096 * freq)) - 1, done with a rounded integer division
+    const uint32_t divisor = (uint32_t)PRESCALE_DIVISOR * freq;
+    uint8_t prescaler = (uint8_t)(((pca9685->osc_freq + divisor / 2) / divisor) - 1);
 
     pca9685_setPrescaler(pca9685, prescaler);
 }
 
+// convert a servo position to the OFF tick of the output
+uint16_t PCA9685_servoPosToOffTick(const PCA9685_t* pca9685, uint8_t servoPos)
+{
+    return pca9685->offLut[servoPos];
+}
+
 // set one servo position
 void PCA9685_setServoPos(const PCA9685_t* pca9685, uint8_t outputPin, uint8_t servoPos)
+{
+    const uint16_t ON_POS = pca9685->onTick[outputPin];
+    const uint16_t OFF_POS = pca9685_offTick(pca9685, outputPin, servoPos);
+
+    pca9685_setPWM(pca9685, outputPin, ON_POS, OFF_POS);
+}
+
+/**
+ * Set every output of the chip to the same position.
+ * 
+ * The ALL_LED registers load all 16 LEDn_ON/OFF registers at once, so this is one 4 byte write instead
+ * of one per output. Output 0 is included, callers that use it for something else must not use this.
+ */
+esp_err_t PCA9685_setAllServoPos(PCA9685_t* pca9685, uint8_t servoPos)
 {
     const uint16_t ON_POS = 0;
-    uint16_t OFF_POS = (uint16_t)round(GAIN_SERVO * servoPos + MIN_OFF_POS_SERVO);
+    const uint16_t OFF_POS = PCA9685_servoPosToOffTick(pca9685, servoPos);
 
-    if (pca9685->isLed)
+    uint8_t data[SET_PWM_SIZE] = {0};
+    pca9685_packPWM(data, ON_POS, OFF_POS);
+
+    esp_err_t err = I2C_writeRegPrio(pca9685->addr, PCA9685_ALLLED_ON_L, data, SET_PWM_SIZE, pca9685->priority);
+
+    for (uint8_t i = 0; i < PCA9685_NUM_CHANNELS; i++)
     {
-        OFF_POS = (uint16_t)round(GAIN_LED * servoPos + MIN_OFF_POS_LED);
-    } 
+        // outputs with a staggered ON tick no longer match their handle, force them to be rewritten
+        bool matches = (err == ESP_OK) && (pca9685->onTick[i] == ON_POS);
+        pca9685->offShadow[i] = matches ? OFF_POS : PCA9685_SHADOW_INVALID;
+    }
 
-    pca9685_setPWM(pca9685, outputPin, ON_POS, OFF_POS);
+    return err;
 }
 
-// set all servo position to the same
-void PCA9685_setAllServoPos(const PCA9685_t* pca9685, uint8_t servoPos)
+/**
+ * Set a run of servo positions in one transaction.
+ * 
+ * MODE1_AI is set in PCA9685_init, so the chip walks LEDn_ON_L..LEDn_OFF_H of consecutive outputs
+ * on its own and we only pay the start, address and register bytes once for the whole run.
+ */
+esp_err_t PCA9685_setServoPosRange(PCA9685_t* pca9685, uint8_t firstPin, uint8_t numPins, const uint8_t* servoPos)
 {
-    const uint16_t ON_POS = 0;
-    uint16_t OFF_POS = (uint16_t)round(GAIN_SERVO * servoPos + MIN_OFF_POS_SERVO);
+    if (numPins == 0 || (firstPin + numPins) > PCA9685_NUM_CHANNELS)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
 
-    if (pca9685->isLed)
+    uint16_t offPos[PCA9685_NUM_CHANNELS] = {0};
+
+    for (uint8_t i = 0; i < numPins; i++)
     {
-        OFF_POS = (uint16_t)round(GAIN_LED * servoPos + MIN_OFF_POS_LED);
-    } 
-    
-    for (uint8_t i = 0; i < TOTAL_NUM_SERVO; i++)
+        offPos[i] = pca9685_offTick(pca9685, firstPin + i, servoPos[i]);
+    }
+
+    return pca9685_writeOffRun(pca9685, firstPin, numPins, offPos);
+}
+
+/**
+ * Only send what actually changes on the chip.
+ * 
+ * A dirty position can still map to the same OFF tick that is already latched (e.g. it moved back),
+ * so the shadow registers are the final word. Changed outputs next to each other are sent as one burst,
+ * a gap of unchanged outputs splits the run.
+ */
+esp_err_t PCA9685_updateServoPosRange(PCA9685_t* pca9685, uint8_t firstPin, uint8_t numPins, const uint8_t* servoPos, uint16_t dirtyMask)
+{
+    if (numPins == 0 || (firstPin + numPins) > PCA9685_NUM_CHANNELS)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_err_t ret = ESP_OK;
+
+    uint16_t offPos[PCA9685_NUM_CHANNELS] = {0};
+    uint8_t runStart = 0;
+    uint8_t runLen = 0;
+
+    // one extra pass with i == numPins flushes the last run
+    for (uint8_t i = 0; i <= numPins; i++)
+    {
+        bool changed = false;
+
+        if (i < numPins && (dirtyMask & (1 << i)))
+        {
+            offPos[i] = pca9685_offTick(pca9685, firstPin + i, servoPos[i]);
+            changed = (offPos[i] != pca9685->offShadow[firstPin + i]);
+        }
+
+        if (changed)
+        {
+            if (runLen == 0)
+            {
+                runStart = i;
+            }
+            runLen++;
+        }
+        else if (runLen > 0)
+        {
+            esp_err_t err = pca9685_writeOffRun(pca9685, firstPin + runStart, runLen, &offPos[runStart]);
+            if (ret == ESP_OK)
+            {
+                ret = err;
+            }
+            runLen = 0;
+        }
+    }
+
+    return ret;
+}
+
+/**
+ * Commit a whole frame at once.
+ * 
+ * PCA9685_updateServoPosRange splits a frame into one burst per run of changed outputs, and every burst
+ * ends in its own STOP, so a frame can land over several PWM periods and tear. Here the span from the
+ * first to the last changed output is sent as one burst, unchanged outputs inside it just get their
+ * current value again, so the chip latches the whole frame on a single STOP.
+ */
+esp_err_t PCA9685_commitServoFrame(PCA9685_t* pca9685, const uint8_t servoPos[PCA9685_NUM_CHANNELS], uint16_t dirtyMask)
+{
+    uint16_t offPos[PCA9685_NUM_CHANNELS] = {0};
+    int8_t firstPin = -1;
+    int8_t lastPin = -1;
+
+    for (uint8_t i = 0; i < PCA9685_NUM_CHANNELS; i++)
+    {
+        if (!(dirtyMask & (1 << i)))
+        {
+            continue;
+        }
+
+        if (pca9685_offTick(pca9685, i, servoPos[i]) != pca9685->offShadow[i])
+        {
+            if (firstPin < 0)
+            {
+                firstPin = i;
+            }
+            lastPin = i;
+        }
+    }
+
+    // nothing differs from what the chip already has
+    if (firstPin < 0)
+    {
+        return ESP_OK;
+    }
+
+    for (uint8_t i = firstPin; i <= lastPin; i++)
+    {
+        offPos[i] = pca9685_offTick(pca9685, i, servoPos[i]);
+    }
+
+    esp_err_t err = pca9685_writeOffRun(pca9685, firstPin, lastPin - firstPin + 1, &offPos[firstPin]);
+
+    if (err == ESP_OK)
     {
-        pca9685_setPWM(pca9685, i, ON_POS, OFF_POS);
+        pca9685->frameApplied = TIMER_restart();
+        pca9685->framesApplied++;
     }
+
+    return err;
 }
+
+/**
+ * Set the same run of outputs on every chip with one burst to the All Call address.
+ * 
+ * Every chip with MODE1_ALLCAL set latches the burst, so e.g. the whole course can be flattened in a single
+ * transaction. The positions are converted with the first handle's table, which is why all handles have
+ * to be the same variant.
+ */
+esp_err_t PCA9685_broadcastServoPosRange(PCA9685_t* pca9685s, uint8_t numPca9685s, uint8_t firstPin, uint8_t numPins, const uint8_t* servoPos)
+{
+    if (numPca9685s == 0 || numPins == 0 || (firstPin + numPins) > PCA9685_NUM_CHANNELS)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    uint16_t offPos[PCA9685_NUM_CHANNELS] = {0};
+    uint8_t data[PCA9685_NUM_CHANNELS * SET_PWM_SIZE] = {0};
+    uint8_t regAddr = PCA9685_LED0_ON_L + PCA9685_LEDX_OFFSET * firstPin;
+
+    for (uint8_t i = 0; i < numPins; i++)
+    {
+        offPos[i] = pca9685_offTick(&pca9685s[0], firstPin + i, servoPos[i]);
+    }
+
+    pca9685_packOffRun(data, &pca9685s[0].onTick[firstPin], numPins, offPos);
+
+    esp_err_t err = I2C_writeRegPrio(PCA9685_ALLCALL_ADDR, regAddr, data, numPins * SET_PWM_SIZE, pca9685s[0].priority);
+
+    /**
+     * The chips ACK together, so an ACK only proves that one of them took it. They share the bus and the
+     * config, so on success all shadows are updated, on failure none of them can be trusted.
+     */
+    for (uint8_t n = 0; n < numPca9685s; n++)
+    {
+        for (uint8_t i = 0; i < numPins; i++)
+        {
+            // a chip whose handle staggers this output differently got the first chip's ON tick, rewrite it later
+            bool matches = (err == ESP_OK) && (pca9685s[n].onTick[firstPin + i] == pca9685s[0].onTick[firstPin + i]);
+            pca9685s[n].offShadow[firstPin + i] = matches ? offPos[i] : PCA9685_SHADOW_INVALID;
+        }
+    }
+
+    return err;
+}
\ No newline at end of file
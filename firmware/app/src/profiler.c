@@ -0,0 +1,58 @@
+#include "profiler.h"
+
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+// Every histogram is only written by the task it profiles, the critical sections keep readers from seeing half a sample
+ProfHist_t profHists[NUM_PROF_HISTS] = {0};
+
+uint8_t prof_bucket(uint32_t us);
+
+uint8_t prof_bucket(uint32_t us)
+{
+    uint8_t bucket = 0;
+
+    while (us != 0 && bucket < (PROF_NUM_BUCKETS - 1))
+    {
+        us >>= 1;
+        bucket++;
+    }
+
+    return bucket;
+}
+
+void PROF_record(ProfHist_e hist, uint32_t us)
+{
+    ProfHist_t* h = &profHists[hist];
+    const uint8_t bucket = prof_bucket(us);
+
+    taskENTER_CRITICAL();
+    h->count++;
+    h->totalUs += us;
+    h->buckets[bucket]++;
+    if (us > h->maxUs)
+    {
+        h->maxUs = us;
+    }
+    taskEXIT_CRITICAL();
+}
+
+void PROF_end(ProfHist_e hist, Timer_t start)
+{
+    PROF_record(hist, (uint32_t)TIMER_get_us(start));
+}
+
+void PROF_get_hist(ProfHist_e hist, ProfHist_t* out)
+{
+    taskENTER_CRITICAL();
+    *out = profHists[hist];
+    taskEXIT_CRITICAL();
+}
+
+void PROF_reset(void)
+{
+    taskENTER_CRITICAL();
+    memset(profHists, 0, sizeof(profHists));
+    taskEXIT_CRITICAL();
+}
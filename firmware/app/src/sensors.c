@@ -2,167 +2,506 @@
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/timers.h"
 
+#include <string.h>
+#include "esp_attr.h"
+#include "esp_timer.h"
+#include "esp8266/gpio_struct.h"
 
 #include "gpio.h"
 #include "delay.h"
+#include "mem_report.h"
+#include "profiler.h"
 
+// overridable so the replay tool (tools/sensor_replay) can be built with other values
+#ifndef DEBOUNCE_DELAY_MS
 #define DEBOUNCE_DELAY_MS       15
-#define SENSOR_TASK_DELAY_MS    1
+#endif
+#ifndef BQ_DEBOUNCE_DELAY_MS
+#define BQ_DEBOUNCE_DELAY_MS    10
+#endif
+#define SNS_EVENT_QUEUE_LEN     8
+#define US_PER_MS               1000
+#define MAX_PENDING             8       // confirmations kept per sensor until they are taken
+
+/**
+ * Raw edges from the ISR. A power of 2 so the indexes can free run and wrap, the ISR is the only writer
+ * of edgeHead and the debounce timers the only writer of edgeTail, so no lock is needed. The timers all
+ * run in the timer service task, one after the other, so there is only ever one reader.
+ */
+#define EDGE_RING_SIZE          32
+#define EDGE_RING_MASK          (EDGE_RING_SIZE - 1)
+
+// The capture ring, also a power of 2. Its edges pack the sensor in the low bits and the level in the top bit.
+#define CAPTURE_MASK            (SNS_CAPTURE_LEN - 1)
+#define CAPTURE_LEVEL_SHIFT     7
+
+#define PIN_MASK(PIN_NUM)       (1 << (PIN_NUM))
+#define SENSOR_PIN_MASK         (PIN_MASK(BIH_GPIO_IN) | PIN_MASK(BIG_GPIO_IN) | PIN_MASK(BD_GPIO_IN) | PIN_MASK(BQ_GPIO_IN))
+
+// A raw edge, as the ISR saw it
+typedef struct {
+    uint8_t sensor;
+    uint8_t level;
+    int64_t timestampUs;
+} SnsEdge_t;
 
-typedef struct{
+typedef struct {
     gpio_num_t gpio;
     int confirmed_level;
+    uint32_t debounceMs;
+
+    bool candidate;             // at the confirmed level since candidateUs, not held long enough yet
+    int64_t candidateUs;
+    bool latched;               // confirmed, stays latched until the sensor leaves the confirmed level
+
+    // written by the ISR, so a sensor whose edges didn't fit in the ring can be put right from the pin
+    volatile bool overflowed;           // edges of this sensor were dropped since the last timer ran
+    volatile int64_t lastTowardUs;      // last edge to the confirmed level
+    volatile int64_t lastAwayUs;        // last edge away from it
 
-    bool detected;
-    bool confirmed;
-    Timer_t timer;
+    TimerHandle_t debounceTimer;        // one shot, restarted by every edge to the confirmed level
+    StaticTimer_t debounceTimerBuffer;
+
+    uint8_t pending;            // confirmations not taken yet
+    int64_t pendingUs[MAX_PENDING];     // their edge times, oldest first, only the latest are kept if it overflows
 } GpioSensor_t;
 
 typedef struct {
-    GpioSensor_t BIH;
-    GpioSensor_t BIG;
-    GpioSensor_t BD;
-    GpioSensor_t BQ;
+    GpioSensor_t sensor[NUM_SENSORS];
+
+    volatile SnsEdge_t edges[EDGE_RING_SIZE];
+    volatile uint32_t edgeHead;
+    volatile uint32_t edgeTail;
+    volatile uint32_t droppedEdges;
+
+    // capture of the raw edges, overwrites the oldest once full
+    volatile bool capturing;
+    int64_t captureStartUs;
+    int64_t captureStopUs;
+    volatile uint32_t captureHead;              // edges captured since the start, free running
+    uint32_t captureTimeUs[SNS_CAPTURE_LEN];    // since captureStartUs
+    uint8_t captureEdge[SNS_CAPTURE_LEN];
 } Sensors_t;
 
-volatile Sensors_t sensors = {.BIH.gpio = BIH_GPIO_IN, .BIH.confirmed_level = GPIO_LOW, .BIH.detected = false, .BIH.confirmed = false, .BIH.timer = 0,
-                              .BIG.gpio = BIG_GPIO_IN, .BIG.confirmed_level = GPIO_LOW, .BIG.detected = false, .BIG.confirmed = false, .BIG.timer = 0,
-                              .BD.gpio  = BD_GPIO_IN , .BD.confirmed_level  = GPIO_HIGH, .BD.detected  = false, .BD.confirmed  = false, .BD.timer  = 0,
-                              .BQ.gpio  = BQ_GPIO_IN, .BQ.confirmed_level   = GPIO_HIGH, .BQ.detected  = false, .BQ.confirmed  = false, .BQ.timer  = 0};
-
-
-// Common ISR
-static void sensor_gpio_isr_handler(void* arg)
+Sensors_t sensors = {
+    .sensor = {
+        [SNS_BALL_IN_HOLE]   = {.gpio = BIH_GPIO_IN, .confirmed_level = GPIO_LOW,  .debounceMs = DEBOUNCE_DELAY_MS},
+        [SNS_BALL_IN_GUTTER] = {.gpio = BIG_GPIO_IN, .confirmed_level = GPIO_LOW,  .debounceMs = DEBOUNCE_DELAY_MS},
+        [SNS_BALL_DEP]       = {.gpio = BD_GPIO_IN,  .confirmed_level = GPIO_HIGH, .debounceMs = DEBOUNCE_DELAY_MS},
+        [SNS_BALL_QUEUE]     = {.gpio = BQ_GPIO_IN,  .confirmed_level = GPIO_HIGH, .debounceMs = BQ_DEBOUNCE_DELAY_MS},
+    },
+};
+
+QueueHandle_t sensorEvents = NULL;
+StaticQueue_t sensorEventsBuffer;
+uint8_t sensorEventsStorage[SNS_EVENT_QUEUE_LEN * sizeof(SnsEvent_t)];
+
+void post_event(SensorId_e sensor, int64_t timestampUs);
+void drain_edges(void);
+void debounce_timer_callback(TimerHandle_t timer);
+void handle_edge(GpioSensor_t* sensor, uint8_t level, int64_t timestampUs);
+void resync_if_overflowed(GpioSensor_t* sensor);
+void confirm_if_held(SensorId_e id, int64_t nowUs, uint8_t level);
+bool take_confirmation(SensorId_e id, int64_t* timestampUs);
+void clear_confirmations(SensorId_e id);
+
+/**
+ * One ISR for every sensor pin. The interrupt status and the input levels are each read once, so every
+ * edge of the same interrupt gets the same timestamp and the level the pin had at that moment.
+ * An edge to the confirmed level (re)starts the sensor's debounce timer, nothing runs until it ends.
+ */
+static void IRAM_ATTR sensor_gpio_isr(void* arg)
 {
-    uint32_t gpio_num = (uint32_t) arg;
+    const uint32_t status = GPIO.status.val;
+    const uint32_t levels = GPIO.in.val;
+    const int64_t now = esp_timer_get_time();
+    BaseType_t woken = pdFALSE;
+
+    GPIO.status_w1tc.val = status;
 
-    switch (gpio_num)
+    for (uint8_t i = 0; i < NUM_SENSORS; i++)
     {
-        case BIH_GPIO_IN:
-            sensors.BIH.detected = true;
-            sensors.BIH.timer = TIMER_restart();
-            break;
+        GpioSensor_t* sensor = &sensors.sensor[i];
+        const uint32_t pinMask = PIN_MASK(sensor->gpio);
+
+        if (!(status & pinMask))
+        {
+            continue;
+        }
+
+        const uint8_t level = (levels & pinMask) ? GPIO_HIGH : GPIO_LOW;
+
+        if (level == sensor->confirmed_level)
+        {
+            sensor->lastTowardUs = now;
+        }
+        else
+        {
+            sensor->lastAwayUs = now;
+        }
+
+        // captured as seen on the pin, even if the edge ring has no room for it
+        if (sensors.capturing)
+        {
+            const uint32_t slot = sensors.captureHead & CAPTURE_MASK;
+
+            sensors.captureTimeUs[slot] = (uint32_t)(now - sensors.captureStartUs);
+            sensors.captureEdge[slot] = i | (level << CAPTURE_LEVEL_SHIFT);
+            sensors.captureHead++;
+        }
+
+        /**
+         * The ring is only drained when a debounce timer runs, a long enough bounce fills it. The edge is
+         * dropped then, but the timer still restarts so the sensor is put right from its pin once it settles.
+         */
+        const uint32_t head = sensors.edgeHead;
+        if ((head - sensors.edgeTail) >= EDGE_RING_SIZE)
+        {
+            sensors.droppedEdges++;
+            sensor->overflowed = true;
+        }
+        else
+        {
+            volatile SnsEdge_t* edge = &sensors.edges[head & EDGE_RING_MASK];
+            edge->sensor = i;
+            edge->level = level;
+            edge->timestampUs = now;
 
-        case BIG_GPIO_IN:
-            sensors.BIG.detected = true;
-            sensors.BIG.timer = TIMER_restart();
-            break;
+            // publish the edge only once it is written
+            sensors.edgeHead = head + 1;
+        }
 
-        case BD_GPIO_IN:
-            sensors.BD.detected = true;
-            sensors.BD.timer = TIMER_restart();
-            break;
+        // edges away from the confirmed level only cancel, the next timer to run drains them
+        if (level == sensor->confirmed_level)
+        {
+            xTimerResetFromISR(sensor->debounceTimer, &woken);
+        }
+    }
 
-        case BQ_GPIO_IN:
-            sensors.BQ.detected = true;
-            sensors.BQ.timer = TIMER_restart();
-            break;
+    if (woken == pdTRUE)
+    {
+        portYIELD_FROM_ISR();
     }
 }
 
-void generic_gpio_debounce_read(volatile GpioSensor_t* sensor, uint32_t debounceTime)
+// Never blocks, if the queue is full the waiter is already behind and will see the pending confirmations anyways
+void post_event(SensorId_e sensor, int64_t timestampUs)
 {
-    if (sensor->detected && !sensor->confirmed)
+    const SnsEvent_t event = { .sensor = sensor, .timestampUs = timestampUs };
+
+    if (sensorEvents != NULL)
     {
-        int gpio_level = gpio_get_level(sensor->gpio);
+        xQueueSend(sensorEvents, &event, 0);
+    }
+}
 
-        if (gpio_level == sensor->confirmed_level)
-        {
-            if (TIMER_get_ms(sensor->timer) > debounceTime)
-            {
-                sensor->confirmed = true;
-            }
-        }
-        else
+/**
+ * A sensor becomes a candidate on an edge to its confirmed level and is confirmed once it has stayed there
+ * for its debounce time. Any edge away from the confirmed level cancels the candidate and re-arms the sensor.
+ */
+void handle_edge(GpioSensor_t* sensor, uint8_t level, int64_t timestampUs)
+{
+    if (level == sensor->confirmed_level)
+    {
+        if (!sensor->candidate && !sensor->latched)
         {
-            sensor->detected = false;
+            sensor->candidate = true;
+            sensor->candidateUs = timestampUs;
         }
     }
+    else
+    {
+        sensor->candidate = false;
+        sensor->latched = false;
+    }
 }
 
-void check_ball_in_hole(void)
+/**
+ * Dropped edges leave the candidate wrong. If the sensor left the confirmed level since the candidate (or
+ * latch) started, or there is none, it is a candidate again from its last edge to the confirmed level.
+ * Only called with the pin at the confirmed level.
+ */
+void resync_if_overflowed(GpioSensor_t* sensor)
 {
-    generic_gpio_debounce_read(&(sensors.BIH), DEBOUNCE_DELAY_MS);
+    taskENTER_CRITICAL();
+    const bool overflowed = sensor->overflowed;
+    const int64_t lastTowardUs = sensor->lastTowardUs;
+    const int64_t lastAwayUs = sensor->lastAwayUs;
+    sensor->overflowed = false;
+    taskEXIT_CRITICAL();
+
+    if (!overflowed)
+    {
+        return;
+    }
+
+    if ((!sensor->candidate && !sensor->latched) || (lastAwayUs >= sensor->candidateUs))
+    {
+        sensor->latched = false;
+        sensor->candidate = true;
+        sensor->candidateUs = lastTowardUs;
+    }
 }
 
-void check_ball_in_gutter(void)
+void confirm_if_held(SensorId_e id, int64_t nowUs, uint8_t level)
 {
-    generic_gpio_debounce_read(&(sensors.BIG), DEBOUNCE_DELAY_MS);
+    GpioSensor_t* sensor = &sensors.sensor[id];
+
+    // the pin has the last word, an edge away from the confirmed level may never have made it into the ring
+    if (level != sensor->confirmed_level)
+    {
+        sensor->candidate = false;
+        sensor->latched = false;
+        return;
+    }
+
+    resync_if_overflowed(sensor);
+
+    const int64_t windowEndUs = sensor->candidateUs + ((int64_t)sensor->debounceMs * US_PER_MS);
+
+    if (!sensor->candidate || nowUs < windowEndUs)
+    {
+        return;
+    }
+
+    // how long after the end of the debounce window the sensor got confirmed
+    PROF_record(PROF_SNS_CONFIRM_DELAY, nowUs - windowEndUs);
+
+    sensor->candidate = false;
+    sensor->latched = true;
+
+    taskENTER_CRITICAL();
+    if (sensor->pending == MAX_PENDING)
+    {
+        // nobody is taking them, keep the latest
+        memmove(&sensor->pendingUs[0], &sensor->pendingUs[1], (MAX_PENDING - 1) * sizeof(int64_t));
+        sensor->pending--;
+    }
+    sensor->pendingUs[sensor->pending++] = sensor->candidateUs;
+    taskEXIT_CRITICAL();
+
+    // the ball queue is counted by the ball queue task itself, nobody waits on it
+    if (id != SNS_BALL_QUEUE)
+    {
+        post_event(id, sensor->candidateUs);
+    }
 }
 
-void check_ball_dep(void)
+// Hands every edge the ISR recorded since the last drain to its sensor
+void drain_edges(void)
 {
-    generic_gpio_debounce_read(&(sensors.BD), DEBOUNCE_DELAY_MS);
+    const uint32_t head = sensors.edgeHead;
+    uint32_t tail = sensors.edgeTail;
+
+    while (tail != head)
+    {
+        const volatile SnsEdge_t* edge = &sensors.edges[tail & EDGE_RING_MASK];
+
+        handle_edge(&sensors.sensor[edge->sensor], edge->level, edge->timestampUs);
+        tail++;
+    }
+
+    // hand the slots back to the ISR only once they are read
+    sensors.edgeTail = tail;
+}
+
+/**
+ * Runs once a sensor has gone a whole debounce window without another edge to its confirmed level. The
+ * edges of every sensor are drained, not just this one's, so the edges that cancel a candidate never sit
+ * in the ring for long.
+ */
+void debounce_timer_callback(TimerHandle_t timer)
+{
+    Timer_t profTimer = TIMER_restart();
+
+    drain_edges();
+
+    const uint32_t levels = GPIO.in.val;
+    const int64_t now = esp_timer_get_time();
+    for (uint8_t i = 0; i < NUM_SENSORS; i++)
+    {
+        const uint8_t level = (levels & PIN_MASK(sensors.sensor[i].gpio)) ? GPIO_HIGH : GPIO_LOW;
+        confirm_if_held(i, now, level);
+    }
+
+    PROF_end(PROF_EXEC_SNS, profTimer);
+}
+
+bool take_confirmation(SensorId_e id, int64_t* timestampUs)
+{
+    GpioSensor_t* sensor = &sensors.sensor[id];
+    bool taken = false;
+
+    taskENTER_CRITICAL();
+    if (sensor->pending > 0)
+    {
+        if (timestampUs != NULL)
+        {
+            *timestampUs = sensor->pendingUs[0];
+        }
+
+        sensor->pending--;
+        memmove(&sensor->pendingUs[0], &sensor->pendingUs[1], sensor->pending * sizeof(int64_t));
+        taken = true;
+    }
+    taskEXIT_CRITICAL();
+
+    return taken;
 }
 
-void check_ball_queue(void)
+void clear_confirmations(SensorId_e id)
 {
-    generic_gpio_debounce_read(&(sensors.BQ), 10);
+    taskENTER_CRITICAL();
+    sensors.sensor[id].pending = 0;
+    taskEXIT_CRITICAL();
 }
 
 void SNS_init(void)
 {
-    gpio_install_isr_service(0);
+    sensorEvents = xQueueCreateStatic(SNS_EVENT_QUEUE_LEN, sizeof(SnsEvent_t), sensorEventsStorage, &sensorEventsBuffer);
+    MEM_count_static(MEM_MOD_SENSORS, sizeof(sensorEventsStorage) + sizeof(sensorEventsBuffer) + sizeof(sensors));
+
+    /**
+     * A tick more than the debounce time: the timer counts from the tick the edge came in on, which has
+     * partly gone by already, so it never ends before the sensor has been held for the whole window.
+     */
+    for (uint8_t i = 0; i < NUM_SENSORS; i++)
+    {
+        sensors.sensor[i].debounceTimer = xTimerCreateStatic("debounce", pdMS_TO_TICKS(sensors.sensor[i].debounceMs) + 1,
+                                                             pdFALSE, NULL, debounce_timer_callback,
+                                                             &sensors.sensor[i].debounceTimerBuffer);
+    }
+
+    sensors.edgeHead = 0;
+    sensors.edgeTail = 0;
+    sensors.droppedEdges = 0;
+
+    // the sensor pins interrupt on both edges (see gpio.c), drop whatever came in before the ISR is there
+    GPIO.status_w1tc.val = SENSOR_PIN_MASK;
+    gpio_isr_register(sensor_gpio_isr, NULL, 0, NULL);
 
-    gpio_isr_handler_add(BIH_GPIO_IN, sensor_gpio_isr_handler, (void *) BIH_GPIO_IN);
-    gpio_isr_handler_add(BIG_GPIO_IN, sensor_gpio_isr_handler, (void *) BIG_GPIO_IN);
-    gpio_isr_handler_add(BD_GPIO_IN, sensor_gpio_isr_handler, (void *) BD_GPIO_IN);
-    gpio_isr_handler_add(BQ_GPIO_IN, sensor_gpio_isr_handler, (void *) BQ_GPIO_IN);
-    
     gpio_set_level(16, 1);
+}
 
+bool SNS_wait_event(SnsEvent_t* event, TickType_t timeout)
+{
+    return xQueueReceive(sensorEvents, event, timeout) == pdTRUE;
+}
 
+void SNS_wake(void)
+{
+    post_event(SNS_WAKE, 0);
+}
+
+bool SNS_take(SensorId_e sensor, int64_t* timestampUs)
+{
+    if (sensor >= NUM_SENSORS)
+    {
+        return false;
+    }
+
+    return take_confirmation(sensor, timestampUs);
+}
+
+uint32_t SNS_get_dropped_edges(void)
+{
+    return sensors.droppedEdges;
+}
+
+void SNS_capture_start(void)
+{
+    taskENTER_CRITICAL();
+    sensors.captureHead = 0;
+    sensors.captureStartUs = esp_timer_get_time();
+    sensors.capturing = true;
+    taskEXIT_CRITICAL();
+}
+
+void SNS_capture_stop(void)
+{
+    taskENTER_CRITICAL();
+    if (sensors.capturing)
+    {
+        sensors.capturing = false;
+        sensors.captureStopUs = esp_timer_get_time();
+    }
+    taskEXIT_CRITICAL();
+}
+
+void SNS_capture_get_info(SnsCaptureInfo_t* info)
+{
+    taskENTER_CRITICAL();
+    const uint32_t head = sensors.captureHead;
+    const int64_t endUs = sensors.capturing ? esp_timer_get_time() : sensors.captureStopUs;
+
+    info->running = sensors.capturing;
+    info->numEdges = (head < SNS_CAPTURE_LEN) ? head : SNS_CAPTURE_LEN;
+    info->lostEdges = head - info->numEdges;
+    info->lengthUs = (head > 0 || sensors.capturing) ? (uint32_t)(endUs - sensors.captureStartUs) : 0;
+    taskEXIT_CRITICAL();
+}
+
+bool SNS_capture_get_edge(uint32_t index, SnsCaptureEdge_t* edge)
+{
+    bool found = false;
+
+    taskENTER_CRITICAL();
+    const uint32_t head = sensors.captureHead;
+    const uint32_t numEdges = (head < SNS_CAPTURE_LEN) ? head : SNS_CAPTURE_LEN;
+
+    if (index < numEdges)
+    {
+        const uint32_t slot = (head - numEdges + index) & CAPTURE_MASK;
+
+        edge->timeUs = sensors.captureTimeUs[slot];
+        edge->sensor = sensors.captureEdge[slot] & ~(1 << CAPTURE_LEVEL_SHIFT);
+        edge->level = sensors.captureEdge[slot] >> CAPTURE_LEVEL_SHIFT;
+        found = true;
+    }
+    taskEXIT_CRITICAL();
+
+    return found;
 }
 
 bool SNS_get_ball_in_hole(void)
 {
-    return sensors.BIH.confirmed;
+    return sensors.sensor[SNS_BALL_IN_HOLE].pending > 0;
 }
 
 void SNS_clear_ball_in_hole(void)
 {
-    sensors.BIH.confirmed = false;
-    sensors.BIH.detected = false;
+    clear_confirmations(SNS_BALL_IN_HOLE);
 }
 
 bool SNS_get_ball_in_gutter(void)
 {
-    return sensors.BIG.confirmed;
+    return sensors.sensor[SNS_BALL_IN_GUTTER].pending > 0;
 }
 
 void SNS_clear_ball_in_gutter(void)
 {
-    sensors.BIG.confirmed = false;
-    sensors.BIG.detected = false;
+    clear_confirmations(SNS_BALL_IN_GUTTER);
 }
 
 bool SNS_get_ball_dep(void)
 {
-    return sensors.BD.confirmed;
+    return sensors.sensor[SNS_BALL_DEP].pending > 0;
 }
 
 void SNS_clear_ball_dep(void)
 {
-    sensors.BD.confirmed = false;
-    sensors.BD.detected = false;
-    }
+    clear_confirmations(SNS_BALL_DEP);
+}
 
 bool SNS_get_ball_queue(void)
 {
-    return sensors.BQ.confirmed;
+    return sensors.sensor[SNS_BALL_QUEUE].pending > 0;
 }
 
 void SNS_clear_ball_queue(void)
 {
-    sensors.BQ.confirmed = false;
-    sensors.BQ.detected = false;
+    clear_confirmations(SNS_BALL_QUEUE);
 }
-
-void SNS_run_task(void)
-{
-    check_ball_in_hole();
-    check_ball_in_gutter();
-    check_ball_dep();
-    check_ball_queue();
-}
\ No newline at end of file
@@ -0,0 +1,110 @@
+#include "task_monitor.h"
+#include "delay.h"
+#include "profiler.h"
+
+#include <stdbool.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define US_PER_MS               1000
+
+/**
+ * A pass may start up to a tick late without it being a miss, vTaskDelayUntil only wakes on ticks and the
+ * tick interrupt itself can be held off for a bit.
+ */
+#define WAKE_TOLERANCE_US       (portTICK_PERIOD_MS * US_PER_MS)
+
+typedef struct {
+    TaskMonStats_t stats;
+    Timer_t passStart;
+    bool started;               // passStart holds the start of a previous pass
+    bool overran;               // the previous pass ran longer than a period, already counted as a miss
+} TaskMon_t;
+TaskMon_t taskMon[NUM_TASKMON_TASKS] = {0};
+
+void taskmon_overrun(TaskMon_t* mon, int64_t overrunUs);
+
+void taskmon_overrun(TaskMon_t* mon, int64_t overrunUs)
+{
+    mon->stats.misses++;
+
+    if (overrunUs > mon->stats.worstOverrunUs)
+    {
+        mon->stats.worstOverrunUs = overrunUs;
+    }
+}
+
+void TASKMON_init(TaskMonId_e task, uint32_t periodMs)
+{
+    taskMon[task].stats.periodUs = periodMs * US_PER_MS;
+    taskMon[task].started = false;
+    taskMon[task].overran = false;
+}
+
+void TASKMON_pass_start(TaskMonId_e task)
+{
+    TaskMon_t* mon = &taskMon[task];
+    const Timer_t now = TIMER_restart();
+
+    /**
+     * Late start, a higher priority task held this one off. When the previous pass overran this start is
+     * late because of it, that miss was counted when the pass ended.
+     */
+    if (mon->started)
+    {
+        const int64_t sinceLastUs = now - mon->passStart;
+        const int64_t jitterUs = sinceLastUs - mon->stats.periodUs;
+
+        PROF_record(PROF_JITTER_ACTUATOR_CONTROL + task, (jitterUs < 0) ? -jitterUs : jitterUs);
+
+        if (!mon->overran && (sinceLastUs > (int64_t)mon->stats.periodUs + WAKE_TOLERANCE_US))
+        {
+            taskmon_overrun(mon, sinceLastUs - mon->stats.periodUs);
+        }
+    }
+
+    mon->passStart = now;
+    mon->started = true;
+    mon->overran = false;
+}
+
+void TASKMON_pass_end(TaskMonId_e task)
+{
+    TaskMon_t* mon = &taskMon[task];
+    const int64_t execUs = TIMER_get_us(mon->passStart);
+
+    mon->stats.runs++;
+
+    if (execUs > mon->stats.worstExecUs)
+    {
+        mon->stats.worstExecUs = execUs;
+    }
+
+    // the pass itself took longer than the period, the next one is already late
+    mon->overran = (execUs > mon->stats.periodUs);
+    if (mon->overran)
+    {
+        taskmon_overrun(mon, execUs - mon->stats.periodUs);
+    }
+}
+
+void TASKMON_get_stats(TaskMonId_e task, TaskMonStats_t* stats)
+{
+    taskENTER_CRITICAL();
+    *stats = taskMon[task].stats;
+    taskEXIT_CRITICAL();
+}
+
+void TASKMON_reset_stats(void)
+{
+    taskENTER_CRITICAL();
+    for (uint8_t i = 0; i < NUM_TASKMON_TASKS; i++)
+    {
+        const uint32_t periodUs = taskMon[i].stats.periodUs;
+
+        memset(&taskMon[i].stats, 0, sizeof(taskMon[i].stats));
+        taskMon[i].stats.periodUs = periodUs;
+    }
+    taskEXIT_CRITICAL();
+}
@@ -0,0 +1,383 @@
+#include "timeline.h"
+#include "delay.h"
+
+#include <string.h>
+#include "esp_partition.h"
+#include "esp_log.h"
+
+#define TAG "TIMELINE.C"
+
+#define TL_PARTITION_LABEL      "timeline"
+#define TL_PARTITION_SUBTYPE    0x40        // first custom data subtype, see partitions.csv
+
+#define FLASH_SECTOR_SIZE       4096
+#define FLASH_WRITE_ALIGN       4           // flash writes are done in whole words
+#define UPLOAD_CHUNK_SIZE       256         // uploads are staged and written to flash this many bytes at a time
+
+#define FNV_OFFSET_BASIS        0x811C9DC5
+#define FNV_PRIME               0x01000193
+
+// struct describing the timeline player
+typedef struct {
+    const esp_partition_t* partition;
+    bool valid;                     // the stored timeline passed its checks
+    uint16_t numSegments;
+
+    // playback
+    TLCommand_e command;            // TL_STOP while not playing
+    uint16_t segment;               // index of the keyframe being moved to
+    int8_t direction;               // +1 forwards, -1 backwards (ping-pong)
+    bool started;                   // the first keyframe has been played
+    Timer_t startTimer;             // when playback started, every keyframe is due at a fixed offset from it
+    int64_t nextDueMs;              // offset of the next keyframe from startTimer
+
+    // upload
+    size_t uploadLen;
+    size_t uploadOffset;            // flash offset the staged bytes go to
+    uint8_t staged[UPLOAD_CHUNK_SIZE];
+    size_t stagedLen;
+} Timeline_t;
+static Timeline_t timeline;         // static, the /timeline URI descriptor in wifi_init.c shares the name
+
+uint32_t tl_fnv1a(uint32_t hash, const uint8_t* data, size_t len);
+uint16_t tl_get_u16(const uint8_t* data);
+uint32_t tl_get_u32(const uint8_t* data);
+esp_err_t tl_validate(void);
+esp_err_t tl_flush_staged(void);
+esp_err_t tl_read_segment(uint16_t segment, uint8_t data[TL_SEGMENT_SIZE]);
+bool tl_advance(void);
+void tl_play_segment(int64_t lateMs);
+
+uint32_t tl_fnv1a(uint32_t hash, const uint8_t* data, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        hash ^= data[i];
+        hash *= FNV_PRIME;
+    }
+
+    return hash;
+}
+
+uint16_t tl_get_u16(const uint8_t* data)
+{
+    return (uint16_t)data[0] | ((uint16_t)data[1] << 8);
+}
+
+uint32_t tl_get_u32(const uint8_t* data)
+{
+    return (uint32_t)data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+/**
+ * Check the timeline in flash: magic, that it fits the partition and the checksum of the segments.
+ * The segments are streamed through one at a time, a timeline never has to fit in RAM.
+ */
+esp_err_t tl_validate(void)
+{
+    uint8_t header[TL_HEADER_SIZE];
+    uint8_t segment[TL_SEGMENT_SIZE];
+
+    timeline.valid = false;
+    timeline.numSegments = 0;
+
+    if (timeline.partition == NULL)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    esp_err_t err = esp_partition_read(timeline.partition, 0, header, TL_HEADER_SIZE);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+
+    if (tl_get_u32(&header[0]) != TL_MAGIC)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    const uint16_t numSegments = tl_get_u16(&header[4]);
+    const uint32_t checksum = tl_get_u32(&header[8]);
+
+    if (numSegments == 0 || (TL_HEADER_SIZE + (uint32_t)numSegments * TL_SEGMENT_SIZE) > timeline.partition->size)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    uint32_t hash = FNV_OFFSET_BASIS;
+    for (uint16_t i = 0; i < numSegments; i++)
+    {
+        err = esp_partition_read(timeline.partition, TL_HEADER_SIZE + (size_t)i * TL_SEGMENT_SIZE, segment, TL_SEGMENT_SIZE);
+        if (err != ESP_OK)
+        {
+            return err;
+        }
+
+        hash = tl_fnv1a(hash, segment, TL_SEGMENT_SIZE);
+    }
+
+    if (hash != checksum)
+    {
+        return ESP_ERR_INVALID_CRC;
+    }
+
+    timeline.numSegments = numSegments;
+    timeline.valid = true;
+
+    return ESP_OK;
+}
+
+// Write the staged upload bytes, padded with erased flash (0xFF) to a whole word
+esp_err_t tl_flush_staged(void)
+{
+    if (timeline.stagedLen == 0)
+    {
+        return ESP_OK;
+    }
+
+    while (timeline.stagedLen % FLASH_WRITE_ALIGN)
+    {
+        timeline.staged[timeline.stagedLen++] = 0xFF;
+    }
+
+    esp_err_t err = esp_partition_write(timeline.partition, timeline.uploadOffset, timeline.staged, timeline.stagedLen);
+
+    timeline.uploadOffset += timeline.stagedLen;
+    timeline.stagedLen = 0;
+
+    return err;
+}
+
+esp_err_t tl_read_segment(uint16_t segment, uint8_t data[TL_SEGMENT_SIZE])
+{
+    return esp_partition_read(timeline.partition, TL_HEADER_SIZE + (size_t)segment * TL_SEGMENT_SIZE, data, TL_SEGMENT_SIZE);
+}
+
+// Move on to the next keyframe, returns false when a one shot timeline is over
+bool tl_advance(void)
+{
+    const uint16_t last = timeline.numSegments - 1;
+
+    switch (timeline.command)
+    {
+        case TL_LOOP:
+            timeline.segment = (timeline.segment == last) ? 0 : timeline.segment + 1;
+            return true;
+
+        case TL_PING_PONG:
+            if (timeline.numSegments == 1)
+            {
+                return true;
+            }
+
+            if ((timeline.direction > 0 && timeline.segment == last) || (timeline.direction < 0 && timeline.segment == 0))
+            {
+                timeline.direction = -timeline.direction;
+            }
+
+            timeline.segment += timeline.direction;
+            return true;
+
+        case TL_ONE_SHOT:
+        default:
+            if (timeline.segment == last)
+            {
+                return false;
+            }
+
+            timeline.segment++;
+            return true;
+    }
+}
+
+/**
+ * Hand the current keyframe to actuator control and schedule the next one.
+ * 
+ * Going backwards, the move from keyframe n+1 to n replays segment n+1 (its duration and easing) in reverse.
+ * Keyframes are due at fixed offsets from the start of playback, so a keyframe handed over late gets that
+ * much less time and the timeline never drifts.
+ */
+void tl_play_segment(int64_t lateMs)
+{
+    uint8_t data[TL_SEGMENT_SIZE];
+    uint8_t timing[TL_SEGMENT_SIZE];
+
+    if (tl_read_segment(timeline.segment, data) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to read keyframe %d, stopping", timeline.segment);
+        timeline.command = TL_STOP;
+        return;
+    }
+
+    // the segment whose duration and easing lead to this keyframe
+    const uint8_t* timingSrc = data;
+    if (timeline.direction < 0 && tl_read_segment(timeline.segment + 1, timing) == ESP_OK)
+    {
+        timingSrc = timing;
+    }
+
+    const uint16_t durationMs = tl_get_u16(&timingSrc[0]);
+    const ACEasing_e easing = (ACEasing_e)timingSrc[2];
+    const int64_t remainingMs = (durationMs > lateMs) ? (durationMs - lateMs) : 0;
+
+    AC_update_desired_positions_timed(&data[3], (uint32_t)remainingMs, easing);
+
+    timeline.nextDueMs += durationMs;
+}
+
+void TL_init(void)
+{
+    memset(&timeline, 0, sizeof(timeline));
+    timeline.command = TL_STOP;
+
+    timeline.partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, TL_PARTITION_SUBTYPE, TL_PARTITION_LABEL);
+    if (timeline.partition == NULL)
+    {
+        ESP_LOGE(TAG, "No timeline partition, timelines can't be stored");
+        return;
+    }
+
+    if (tl_validate() == ESP_OK)
+    {
+        ESP_LOGI(TAG, "Timeline with %d keyframes in flash", timeline.numSegments);
+    }
+}
+
+esp_err_t TL_upload_begin(size_t totalLen)
+{
+    if (timeline.partition == NULL)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    if (totalLen < TL_HEADER_SIZE || totalLen > timeline.partition->size)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    // playback reads the partition, so it can't go on while the partition is rewritten
+    timeline.command = TL_STOP;
+    timeline.valid = false;
+
+    timeline.uploadLen = totalLen;
+    timeline.uploadOffset = 0;
+    timeline.stagedLen = 0;
+
+    const size_t eraseLen = ((totalLen + FLASH_SECTOR_SIZE - 1) / FLASH_SECTOR_SIZE) * FLASH_SECTOR_SIZE;
+
+    return esp_partition_erase_range(timeline.partition, 0, eraseLen);
+}
+
+esp_err_t TL_upload_write(const uint8_t* data, size_t len)
+{
+    if ((timeline.uploadOffset + timeline.stagedLen + len) > timeline.uploadLen)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    while (len > 0)
+    {
+        size_t take = UPLOAD_CHUNK_SIZE - timeline.stagedLen;
+        if (take > len)
+        {
+            take = len;
+        }
+
+        memcpy(&timeline.staged[timeline.stagedLen], data, take);
+        timeline.stagedLen += take;
+        data += take;
+        len -= take;
+
+        if (timeline.stagedLen == UPLOAD_CHUNK_SIZE)
+        {
+            esp_err_t err = tl_flush_staged();
+            if (err != ESP_OK)
+            {
+                return err;
+            }
+        }
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t TL_upload_end(void)
+{
+    esp_err_t err = tl_flush_staged();
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+
+    err = tl_validate();
+    if (err == ESP_OK)
+    {
+        ESP_LOGI(TAG, "Stored timeline with %d keyframes", timeline.numSegments);
+    }
+    else
+    {
+        ESP_LOGE(TAG, "Uploaded timeline is invalid w/ error code (%d)", err);
+    }
+
+    return err;
+}
+
+esp_err_t TL_command(TLCommand_e command)
+{
+    if (command == TL_STOP)
+    {
+        timeline.command = TL_STOP;
+        return ESP_OK;
+    }
+
+    if (command >= NUM_TL_COMMANDS)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (!timeline.valid)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    timeline.segment = 0;
+    timeline.direction = 1;
+    timeline.started = false;
+    timeline.nextDueMs = 0;
+    timeline.startTimer = TIMER_restart();
+    timeline.command = command;
+
+    return ESP_OK;
+}
+
+bool TL_is_playing(void)
+{
+    return timeline.command != TL_STOP;
+}
+
+void TL_run_task(void)
+{
+    if (timeline.command == TL_STOP)
+    {
+        return;
+    }
+
+    const int64_t elapsedMs = TIMER_get_ms(timeline.startTimer);
+
+    if (elapsedMs < timeline.nextDueMs)
+    {
+        return;
+    }
+
+    // the first keyframe is played straight away, every later one only once there is one to move on to
+    if (timeline.started && !tl_advance())
+    {
+        ESP_LOGI(TAG, "Timeline finished");
+        timeline.command = TL_STOP;
+        return;
+    }
+
+    tl_play_segment(elapsedMs - timeline.nextDueMs);
+    timeline.started = true;
+}
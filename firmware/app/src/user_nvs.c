@@ -6,14 +6,70 @@
 #include "nvs.h"
 #include "esp_log.h"
 #include "esp_system.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "delay.h"
 #include <stdbool.h>
+#include <string.h>
 #include <sys/param.h>
 
 #define NVS_APP_NAMESPACE "storage"
 #define NVS_COURSE_STATE_KEY "course_state"
+#define NVS_PRESET_KEY_FMT "preset_%u"
+#define NVS_PRESET_KEY_LEN 16
 
 #define TAG "USER_NVS.C"
 
+/**
+ * A requested course state is only written after nothing new has been requested for this long and the course
+ * has stopped moving, so a slider dragged in the app ends up as a single write of where it was let go.
+ */
+#define NVS_SAVE_SETTLE_MS      2000
+
+#define FNV_OFFSET_BASIS        0x811C9DC5
+#define FNV_PRIME               0x01000193
+
+// struct describing the deferred course state save
+typedef struct {
+    uint8_t pendingState[NUM_ACTUATORS];    // latest requested course state, guarded by a critical section
+    bool pending;                           // pendingState hasn't been written or skipped yet
+    Timer_t lastRequest;                    // when pendingState last changed
+
+    uint32_t savedHash;                     // hash of the course state in flash
+    bool savedHashValid;                    // false until a course state has been read from or written to flash
+
+    NVSStats_t stats;
+} NVSCourseSave_t;
+NVSCourseSave_t courseSave = {0};
+
+// A preset slot, stored in NVS as one blob per slot and kept in RAM so a recall never waits on flash
+typedef struct {
+    char name[NVS_PRESET_NAME_LEN];
+    uint8_t positions[NUM_ACTUATORS];
+} NVSPreset_t;
+
+typedef struct {
+    NVSPreset_t slots[NVS_NUM_PRESETS];
+    bool used[NVS_NUM_PRESETS];
+} NVSPresets_t;
+static NVSPresets_t presets = {0};  // static, the /presets URI descriptor in wifi_init.c shares the name
+
+uint32_t nvs_hash_course_state(const uint8_t courseState[NUM_ACTUATORS]);
+void nvs_load_presets(void);
+
+uint32_t nvs_hash_course_state(const uint8_t courseState[NUM_ACTUATORS])
+{
+    uint32_t hash = FNV_OFFSET_BASIS;
+
+    for (uint8_t i = 0; i < NUM_ACTUATORS; i++)
+    {
+        hash ^= courseState[i];
+        hash *= FNV_PRIME;
+    }
+
+    return hash;
+}
+
 void NVS_init(void)
 {
     esp_err_t err = nvs_flash_init();
@@ -27,17 +83,54 @@ void NVS_init(void)
             ERRORCODE_set(NVS_ERROR);
         }
     }
+
+    nvs_load_presets();
+}
+
+// Fill the RAM copy of the preset slots, empty slots are simply not found
+void nvs_load_presets(void)
+{
+    nvs_handle_t nvs_handle;
+    char key[NVS_PRESET_KEY_LEN];
+    uint8_t numLoaded = 0;
+
+    memset(&presets, 0, sizeof(presets));
+
+    if (nvs_open(NVS_APP_NAMESPACE, NVS_READWRITE, &nvs_handle) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Error opening NVS handle to read presets");
+        ERRORCODE_set(NVS_ERROR);
+        return;
+    }
+
+    for (uint8_t id = 0; id < NVS_NUM_PRESETS; id++)
+    {
+        size_t size = sizeof(NVSPreset_t);
+        snprintf(key, sizeof(key), NVS_PRESET_KEY_FMT, id);
+
+        if (nvs_get_blob(nvs_handle, key, &presets.slots[id], &size) == ESP_OK && size == sizeof(NVSPreset_t))
+        {
+            presets.used[id] = true;
+            numLoaded++;
+        }
+    }
+
+    nvs_close(nvs_handle);
+
+    ESP_LOGI(TAG, "Loaded %d course presets", numLoaded);
 }
 
 //save
 esp_err_t NVS_write_course_state(uint8_t courseState[NUM_ACTUATORS])
 {
     nvs_handle_t nvs_handle;
+    Timer_t writeTimer = TIMER_restart();
 
     esp_err_t err = nvs_open(NVS_APP_NAMESPACE, NVS_READWRITE, &nvs_handle);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Error (%d) opening NVS handle to write course state", err);
         ERRORCODE_set(NVS_ERROR);
+        courseSave.stats.failures++;
 
         return err;
     }
@@ -45,18 +138,30 @@ esp_err_t NVS_write_course_state(uint8_t courseState[NUM_ACTUATORS])
     err = nvs_set_blob(nvs_handle, NVS_COURSE_STATE_KEY, courseState, NUM_ACTUATORS);
     if (err == ESP_OK)
     {
-        nvs_commit(nvs_handle); // Ensure data is saved
-        ESP_LOGI(TAG, "Successfully saved course state to NVS");
+        err = nvs_commit(nvs_handle); // Ensure data is saved
     }
-    else {
+
+    // Close NVS handle
+    nvs_close(nvs_handle);
+
+    if (err != ESP_OK) {
         ESP_LOGE(TAG, "Failed to save course state to NVS w/ error code (%d)", err);
         ERRORCODE_set(NVS_ERROR);
+        courseSave.stats.failures++;
 
-        return err; 
+        return err;
     }
+    ESP_LOGI(TAG, "Successfully saved course state to NVS");
 
-    // Close NVS handle
-    nvs_close(nvs_handle);
+    courseSave.savedHash = nvs_hash_course_state(courseState);
+    courseSave.savedHashValid = true;
+
+    courseSave.stats.writes++;
+    courseSave.stats.lastWriteUs = TIMER_get_us(writeTimer);
+    if (courseSave.stats.lastWriteUs > courseSave.stats.maxWriteUs)
+    {
+        courseSave.stats.maxWriteUs = courseSave.stats.lastWriteUs;
+    }
 
     return ESP_OK;
 }
@@ -107,10 +212,194 @@ esp_err_t NVS_read_course_state(uint8_t output[NUM_ACTUATORS])
         }
 
         ESP_LOGI(TAG, "Successfully read course state from NVS: %s", log_buffer);
+
+        courseSave.savedHash = nvs_hash_course_state(output);
+        courseSave.savedHashValid = true;
     }
 
     // Close NVS handle
     nvs_close(nvs_handle);
 
     return ESP_OK;
-}
\ No newline at end of file
+}
+
+void NVS_request_course_state_save(const uint8_t courseState[NUM_ACTUATORS])
+{
+    taskENTER_CRITICAL();
+    memcpy(courseSave.pendingState, courseState, NUM_ACTUATORS);
+    courseSave.pending = true;
+    courseSave.lastRequest = TIMER_restart();
+    courseSave.stats.requests++;
+    taskEXIT_CRITICAL();
+}
+
+void NVS_run_task(void)
+{
+    uint8_t courseState[NUM_ACTUATORS];
+
+    if (!courseSave.pending || TIMER_get_ms(courseSave.lastRequest) < NVS_SAVE_SETTLE_MS || !AC_is_settled())
+    {
+        return;
+    }
+
+    // take a copy so the flash write doesn't hold up new requests
+    taskENTER_CRITICAL();
+    memcpy(courseState, courseSave.pendingState, NUM_ACTUATORS);
+    courseSave.pending = false;
+    taskEXIT_CRITICAL();
+
+    if (courseSave.savedHashValid && nvs_hash_course_state(courseState) == courseSave.savedHash)
+    {
+        courseSave.stats.skipped++;
+        return;
+    }
+
+    if (NVS_write_course_state(courseState) == ESP_OK)
+    {
+        ESP_LOGI(TAG, "Course state write took %u us (%u writes, %u skipped, %u requests)",
+                 courseSave.stats.lastWriteUs, courseSave.stats.writes, courseSave.stats.skipped, courseSave.stats.requests);
+        return;
+    }
+
+    // keep it pending and try again once it has waited NVS_SAVE_SETTLE_MS, unless a newer state was requested during the write
+    taskENTER_CRITICAL();
+    if (!courseSave.pending)
+    {
+        memcpy(courseSave.pendingState, courseState, NUM_ACTUATORS);
+        courseSave.pending = true;
+        courseSave.lastRequest = TIMER_restart();
+    }
+    taskEXIT_CRITICAL();
+}
+
+void NVS_get_stats(NVSStats_t* stats)
+{
+    taskENTER_CRITICAL();
+    *stats = courseSave.stats;
+    taskEXIT_CRITICAL();
+}
+
+esp_err_t NVS_save_preset(uint8_t id, const char name[NVS_PRESET_NAME_LEN], const uint8_t positions[NUM_ACTUATORS])
+{
+    nvs_handle_t nvs_handle;
+    char key[NVS_PRESET_KEY_LEN];
+    NVSPreset_t preset;
+
+    if (id >= NVS_NUM_PRESETS)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memcpy(preset.name, name, NVS_PRESET_NAME_LEN);
+    memcpy(preset.positions, positions, NUM_ACTUATORS);
+    snprintf(key, sizeof(key), NVS_PRESET_KEY_FMT, id);
+
+    esp_err_t err = nvs_open(NVS_APP_NAMESPACE, NVS_READWRITE, &nvs_handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error (%d) opening NVS handle to save preset %d", err, id);
+        ERRORCODE_set(NVS_ERROR);
+
+        return err;
+    }
+
+    err = nvs_set_blob(nvs_handle, key, &preset, sizeof(preset));
+    if (err == ESP_OK)
+    {
+        err = nvs_commit(nvs_handle);
+    }
+    nvs_close(nvs_handle);
+
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to save preset %d to NVS w/ error code (%d)", id, err);
+        ERRORCODE_set(NVS_ERROR);
+
+        return err;
+    }
+
+    // only update the RAM copy once flash has it, the two never disagree
+    taskENTER_CRITICAL();
+    presets.slots[id] = preset;
+    presets.used[id] = true;
+    taskEXIT_CRITICAL();
+
+    ESP_LOGI(TAG, "Saved preset %d \"%.*s\"", id, NVS_PRESET_NAME_LEN, preset.name);
+
+    return ESP_OK;
+}
+
+esp_err_t NVS_delete_preset(uint8_t id)
+{
+    nvs_handle_t nvs_handle;
+    char key[NVS_PRESET_KEY_LEN];
+
+    if (id >= NVS_NUM_PRESETS)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (!presets.used[id])
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    snprintf(key, sizeof(key), NVS_PRESET_KEY_FMT, id);
+
+    esp_err_t err = nvs_open(NVS_APP_NAMESPACE, NVS_READWRITE, &nvs_handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error (%d) opening NVS handle to delete preset %d", err, id);
+        ERRORCODE_set(NVS_ERROR);
+
+        return err;
+    }
+
+    err = nvs_erase_key(nvs_handle, key);
+    if (err == ESP_OK)
+    {
+        err = nvs_commit(nvs_handle);
+    }
+    nvs_close(nvs_handle);
+
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to delete preset %d from NVS w/ error code (%d)", id, err);
+        ERRORCODE_set(NVS_ERROR);
+
+        return err;
+    }
+
+    presets.used[id] = false;
+
+    ESP_LOGI(TAG, "Deleted preset %d", id);
+
+    return ESP_OK;
+}
+
+bool NVS_get_preset(uint8_t id, char name[NVS_PRESET_NAME_LEN], uint8_t positions[NUM_ACTUATORS])
+{
+    bool used = false;
+
+    if (id >= NVS_NUM_PRESETS)
+    {
+        return false;
+    }
+
+    taskENTER_CRITICAL();
+    if (presets.used[id])
+    {
+        used = true;
+
+        if (name != NULL)
+        {
+            memcpy(name, presets.slots[id].name, NVS_PRESET_NAME_LEN);
+        }
+
+        if (positions != NULL)
+        {
+            memcpy(positions, presets.slots[id].positions, NUM_ACTUATORS);
+        }
+    }
+    taskEXIT_CRITICAL();
+
+    return used;
+}
@@ -2,6 +2,14 @@
 #include "actuator_control.h"
 #include "ball_estimation.h"
 #include "ball_queue.h"
+#include "animation.h"
+#include "timeline.h"
+#include "user_nvs.h"
+#include "boot.h"
+#include "profiler.h"
+#include "task_monitor.h"
+#include "mem_report.h"
+#include "sensors.h"
 
 #include <sys/param.h>
 #include <string.h>
@@ -17,6 +25,37 @@
 #define COURSE_STATE_POST_REQ_SIZE      (NUM_ACTUATORS + MODES_SIZE)
 #define RESET_STATS_POST_REQ_SIZE       1
 #define DISPENSE_BALLS_POST_REQ_SIZE    1
+#define ANIMATION_POST_REQ_SIZE         (MODES_SIZE + ANIM_PARAMS_SIZE)
+#define TIMELINE_CMD_POST_REQ_SIZE      1
+#define TIMELINE_RECV_BUF_SIZE          256
+#define PRESET_SAVE_POST_REQ_SIZE       (1 + NVS_PRESET_NAME_LEN + NUM_ACTUATORS)
+#define PRESET_ID_POST_REQ_SIZE         1
+#define PRESET_LIST_ENTRY_SIZE          (1 + NVS_PRESET_NAME_LEN)
+#define METRICS_HEADER_SIZE             3
+#define METRICS_HIST_SIZE               (4 + 4 + 8 + (4 * PROF_NUM_BUCKETS))
+#define METRICS_TASK_SIZE               (5 * 4)
+#define METRICS_NVS_SIZE                (6 * 4)
+#define MEMORY_RESP_SIZE                (3 * 4 + 2 + (NUM_MEM_TASKS * 2 * 4) + (NUM_MEM_MODULES * 3 * 4))
+#define ECHO_BUF_SIZE                   256
+#define SENSOR_CAPTURE_CMD_POST_REQ_SIZE 1
+#define SENSOR_CAPTURE_MAGIC            0x31504353  // "SCP1"
+#define SENSOR_CAPTURE_HEADER_SIZE      (4 * 4 + 1)
+#define SENSOR_CAPTURE_EDGE_SIZE        (4 + 1)
+#define SENSOR_CAPTURE_CHUNK_EDGES      64
+#define METRICS_RESP_SIZE               (METRICS_HEADER_SIZE + (NUM_PROF_HISTS * METRICS_HIST_SIZE) + (NUM_TASKMON_TASKS * METRICS_TASK_SIZE) + METRICS_NVS_SIZE)
+
+char* put_u32(char* dest, uint32_t val);
+
+// Little endian, returns where the next value goes
+char* put_u32(char* dest, uint32_t val)
+{
+    for (uint8_t b = 0; b < sizeof(uint32_t); b++)
+    {
+        *dest++ = (val >> (8 * b)) & 0xFF;
+    }
+
+    return dest;
+}
 
 esp_err_t POST_courseState_handler(httpd_req_t *req)
 {
@@ -38,6 +77,9 @@ esp_err_t POST_courseState_handler(httpd_req_t *req)
         return ESP_FAIL;
     }
 
+    // Positions sent by the app take over from a timeline that is playing
+    TL_command(TL_STOP);
+
     // Update the motor positions
     AC_update_mode((uint8_t)buffer[0]);
     AC_update_desired_positions((uint8_t*)&buffer[1]);
@@ -73,6 +115,19 @@ esp_err_t POST_resetStats_handler(httpd_req_t *req)
     return ESP_OK;
 }
 
+// Clears the profiler histograms and the task deadline counters, no payload
+esp_err_t POST_metricsReset_handler(httpd_req_t *req)
+{
+    PROF_reset();
+    TASKMON_reset_stats();
+
+    const char* resp_str = "Successfully reset metrics!";
+    ESP_LOGD(TAG, resp_str);
+    httpd_resp_send(req, resp_str, strlen(resp_str));
+    
+    return ESP_OK;
+}
+
 esp_err_t POST_settings_handler(httpd_req_t *req)
 {
     char buffer[RESET_STATS_POST_REQ_SIZE] = {0};
@@ -136,6 +191,270 @@ esp_err_t POST_dispenseBall_handler(httpd_req_t *req)
     return ESP_OK;
 }
 
+/**
+ * Payload: mode (WAVE or TSUNAMI), amplitude, center, wavelength, speed, direction, one byte each.
+ * See AnimParams_t for the units.
+ */
+esp_err_t POST_animation_handler(httpd_req_t *req)
+{
+    char buffer[ANIMATION_POST_REQ_SIZE] = {0};
+    
+    // Make sure the data length is what we expect
+    int total_len = req->content_len;
+    if (total_len != (ANIMATION_POST_REQ_SIZE)) {
+        ESP_LOGE(TAG, "Invalid data length in POST_animation_handler: %d bytes (expected %d)", total_len, ANIMATION_POST_REQ_SIZE);
+        return ESP_FAIL;
+    }
+
+    // Populate the buffer with the payload
+    int received = httpd_req_recv(req, buffer, sizeof(buffer));
+
+    // Make sure the received data is the size we expect
+    if (received <= 0) {
+        ESP_LOGE(TAG, "Failed to receive data in POST_animation_handler");
+        return ESP_FAIL;
+    }
+
+    const ACMode_e mode = (ACMode_e)buffer[0];
+    if (mode != WAVE && mode != TSUNAMI) {
+        ESP_LOGE(TAG, "Mode %d in POST_animation_handler is not an animation", mode);
+        return ESP_FAIL;
+    }
+
+    AnimParams_t params = {
+        .amplitude  = (uint8_t)buffer[1],
+        .center     = (uint8_t)buffer[2],
+        .wavelength = (uint8_t)buffer[3],
+        .speed      = (uint8_t)buffer[4],
+        .direction  = (uint8_t)buffer[5],
+    };
+    ANIM_set_params((mode == WAVE) ? ANIM_WAVE : ANIM_TSUNAMI, &params);
+
+    const char* resp_str = "Successfully received animation!";
+    ESP_LOGD(TAG, resp_str);
+    httpd_resp_send(req, resp_str, strlen(resp_str));
+
+    return ESP_OK;
+}
+
+
+/**
+ * Payload: a whole timeline in the format described in timeline.h. It is written to flash as it
+ * arrives, so it can be much larger than any buffer on the device.
+ */
+esp_err_t POST_timeline_handler(httpd_req_t *req)
+{
+    char buf[TIMELINE_RECV_BUF_SIZE];
+    int ret, remaining = req->content_len;
+
+    esp_err_t err = TL_upload_begin(remaining);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Can't store a timeline of %d bytes in POST_timeline_handler w/ error code (%d)", remaining, err);
+        return ESP_FAIL;
+    }
+
+    while (remaining > 0) {
+        if ((ret = httpd_req_recv(req, buf, MIN(remaining, sizeof(buf)))) <= 0) {
+            if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
+                /* Retry receiving if timeout occurred */
+                continue;
+            }
+            ESP_LOGE(TAG, "Failed to receive data in POST_timeline_handler");
+            return ESP_FAIL;
+        }
+
+        if (TL_upload_write((const uint8_t*)buf, ret) != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to write timeline to flash in POST_timeline_handler");
+            return ESP_FAIL;
+        }
+        remaining -= ret;
+    }
+
+    if (TL_upload_end() != ESP_OK) {
+        ESP_LOGE(TAG, "Invalid timeline in POST_timeline_handler");
+        return ESP_FAIL;
+    }
+
+    const char* resp_str = "Successfully received timeline!";
+    ESP_LOGD(TAG, resp_str);
+    httpd_resp_send(req, resp_str, strlen(resp_str));
+
+    return ESP_OK;
+}
+
+// Payload: one TLCommand_e byte, stop or how to play the stored timeline
+esp_err_t POST_timelineCmd_handler(httpd_req_t *req)
+{
+    char buffer[TIMELINE_CMD_POST_REQ_SIZE] = {0};
+    
+    // Make sure the data length is what we expect
+    int total_len = req->content_len;
+    if (total_len != TIMELINE_CMD_POST_REQ_SIZE) {
+        ESP_LOGE(TAG, "Invalid data length in POST_timelineCmd_handler: %d bytes (expected %d)", total_len, TIMELINE_CMD_POST_REQ_SIZE);
+        return ESP_FAIL;
+    }
+
+    // Populate the buffer with the payload
+    int received = httpd_req_recv(req, buffer, sizeof(buffer));
+
+    // Make sure the received data is the size we expect
+    if (received <= 0) {
+        ESP_LOGE(TAG, "Failed to receive data in POST_timelineCmd_handler");
+        return ESP_FAIL;
+    }
+
+    if (TL_command((TLCommand_e)buffer[0]) != ESP_OK) {
+        ESP_LOGE(TAG, "Timeline command %d in POST_timelineCmd_handler failed", buffer[0]);
+        return ESP_FAIL;
+    }
+
+    const char* resp_str = "Successfully received timeline command!";
+    ESP_LOGD(TAG, resp_str);
+    httpd_resp_send(req, resp_str, strlen(resp_str));
+
+    return ESP_OK;
+}
+
+
+// Payload: preset id, name (NVS_PRESET_NAME_LEN bytes, zero padded), then the actuator positions
+esp_err_t POST_presetSave_handler(httpd_req_t *req)
+{
+    char buffer[PRESET_SAVE_POST_REQ_SIZE] = {0};
+    
+    // Make sure the data length is what we expect
+    int total_len = req->content_len;
+    if (total_len != PRESET_SAVE_POST_REQ_SIZE) {
+        ESP_LOGE(TAG, "Invalid data length in POST_presetSave_handler: %d bytes (expected %d)", total_len, PRESET_SAVE_POST_REQ_SIZE);
+        return ESP_FAIL;
+    }
+
+    // Populate the buffer with the payload
+    int received = httpd_req_recv(req, buffer, sizeof(buffer));
+
+    // Make sure the received data is the size we expect
+    if (received <= 0) {
+        ESP_LOGE(TAG, "Failed to receive data in POST_presetSave_handler");
+        return ESP_FAIL;
+    }
+
+    if (NVS_save_preset((uint8_t)buffer[0], &buffer[1], (uint8_t*)&buffer[1 + NVS_PRESET_NAME_LEN]) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to save preset %d in POST_presetSave_handler", buffer[0]);
+        return ESP_FAIL;
+    }
+
+    const char* resp_str = "Successfully saved preset!";
+    ESP_LOGD(TAG, resp_str);
+    httpd_resp_send(req, resp_str, strlen(resp_str));
+
+    return ESP_OK;
+}
+
+// Payload: preset id
+esp_err_t POST_presetDelete_handler(httpd_req_t *req)
+{
+    char buffer[PRESET_ID_POST_REQ_SIZE] = {0};
+    
+    // Make sure the data length is what we expect
+    int total_len = req->content_len;
+    if (total_len != PRESET_ID_POST_REQ_SIZE) {
+        ESP_LOGE(TAG, "Invalid data length in POST_presetDelete_handler: %d bytes (expected %d)", total_len, PRESET_ID_POST_REQ_SIZE);
+        return ESP_FAIL;
+    }
+
+    // Populate the buffer with the payload
+    int received = httpd_req_recv(req, buffer, sizeof(buffer));
+
+    // Make sure the received data is the size we expect
+    if (received <= 0) {
+        ESP_LOGE(TAG, "Failed to receive data in POST_presetDelete_handler");
+        return ESP_FAIL;
+    }
+
+    if (NVS_delete_preset((uint8_t)buffer[0]) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to delete preset %d in POST_presetDelete_handler", buffer[0]);
+        return ESP_FAIL;
+    }
+
+    const char* resp_str = "Successfully deleted preset!";
+    ESP_LOGD(TAG, resp_str);
+    httpd_resp_send(req, resp_str, strlen(resp_str));
+
+    return ESP_OK;
+}
+
+// Payload: preset id, the course starts moving to the preset straight away
+esp_err_t POST_presetRecall_handler(httpd_req_t *req)
+{
+    char buffer[PRESET_ID_POST_REQ_SIZE] = {0};
+    uint8_t positions[NUM_ACTUATORS];
+    
+    // Make sure the data length is what we expect
+    int total_len = req->content_len;
+    if (total_len != PRESET_ID_POST_REQ_SIZE) {
+        ESP_LOGE(TAG, "Invalid data length in POST_presetRecall_handler: %d bytes (expected %d)", total_len, PRESET_ID_POST_REQ_SIZE);
+        return ESP_FAIL;
+    }
+
+    // Populate the buffer with the payload
+    int received = httpd_req_recv(req, buffer, sizeof(buffer));
+
+    // Make sure the received data is the size we expect
+    if (received <= 0) {
+        ESP_LOGE(TAG, "Failed to receive data in POST_presetRecall_handler");
+        return ESP_FAIL;
+    }
+
+    // from the RAM copy, a recall never waits on flash
+    if (!NVS_get_preset((uint8_t)buffer[0], NULL, positions)) {
+        ESP_LOGE(TAG, "No preset %d in POST_presetRecall_handler", buffer[0]);
+        return ESP_FAIL;
+    }
+
+    TL_command(TL_STOP);
+    AC_update_mode(STATIC);
+    AC_update_desired_positions(positions);
+
+    const char* resp_str = "Successfully recalled preset!";
+    ESP_LOGD(TAG, resp_str);
+    httpd_resp_send(req, resp_str, strlen(resp_str));
+
+    return ESP_OK;
+}
+
+// Payload: 1 to start a new sensor capture, 0 to stop it
+esp_err_t POST_sensorCaptureCmd_handler(httpd_req_t *req)
+{
+    char buffer[SENSOR_CAPTURE_CMD_POST_REQ_SIZE] = {0};
+    
+    // Make sure the data length is what we expect
+    int total_len = req->content_len;
+    if (total_len != SENSOR_CAPTURE_CMD_POST_REQ_SIZE) {
+        ESP_LOGE(TAG, "Invalid data length in POST_sensorCaptureCmd_handler: %d bytes (expected %d)", total_len, SENSOR_CAPTURE_CMD_POST_REQ_SIZE);
+        return ESP_FAIL;
+    }
+
+    // Populate the buffer with the payload
+    int received = httpd_req_recv(req, buffer, sizeof(buffer));
+
+    // Make sure the received data is the size we expect
+    if (received <= 0) {
+        ESP_LOGE(TAG, "Failed to receive data in POST_sensorCaptureCmd_handler");
+        return ESP_FAIL;
+    }
+
+    if (buffer[0]) {
+        SNS_capture_start();
+    } else {
+        SNS_capture_stop();
+    }
+
+    const char* resp_str = "Successfully received sensor capture command!";
+    ESP_LOGD(TAG, resp_str);
+    httpd_resp_send(req, resp_str, strlen(resp_str));
+
+    return ESP_OK;
+}
+
 
 esp_err_t GET_errorCodes_handler(httpd_req_t *req)
 {
@@ -187,10 +506,224 @@ esp_err_t GET_stats_handler(httpd_req_t *req)
 }
 
 
+// Response: for every preset slot, 1 if it holds a preset followed by its name (NVS_PRESET_NAME_LEN bytes)
+esp_err_t GET_presets_handler(httpd_req_t *req)
+{
+    char resp[NVS_NUM_PRESETS * PRESET_LIST_ENTRY_SIZE] = {0};
+
+    for (uint8_t id = 0; id < NVS_NUM_PRESETS; id++)
+    {
+        char* entry = &resp[id * PRESET_LIST_ENTRY_SIZE];
+        entry[0] = NVS_get_preset(id, &entry[1], NULL);
+    }
+
+    httpd_resp_send(req, resp, sizeof(resp));
+
+    /* After sending the HTTP response the old HTTP request
+     * headers are lost. Check if HTTP request headers can be read now. */
+    if (httpd_req_get_hdr_value_len(req, "Host") == 0) {
+        ESP_LOGD(TAG, "Successfully sent presets via GET_presets_handler!");
+    }
+
+    return ESP_OK;
+}
+
+
+// Response: for every BootPhase_e, the time since power on it finished at in us (uint32, little endian)
+esp_err_t GET_bootTimeline_handler(httpd_req_t *req)
+{
+    uint32_t timestampsUs[NUM_BOOT_PHASES];
+    char resp[NUM_BOOT_PHASES * sizeof(uint32_t)];
+
+    BOOT_get_timeline(timestampsUs);
+
+    for (uint8_t i = 0; i < NUM_BOOT_PHASES; i++)
+    {
+        put_u32(&resp[i * sizeof(uint32_t)], timestampsUs[i]);
+    }
+
+    httpd_resp_send(req, resp, sizeof(resp));
+
+    /* After sending the HTTP response the old HTTP request
+     * headers are lost. Check if HTTP request headers can be read now. */
+    if (httpd_req_get_hdr_value_len(req, "Host") == 0) {
+        ESP_LOGD(TAG, "Successfully sent boot timeline via GET_bootTimeline_handler!");
+    }
+
+    return ESP_OK;
+}
+
+
+/**
+ * Response, all values little endian:
+ *   uint8 NUM_PROF_HISTS, uint8 PROF_NUM_BUCKETS, uint8 NUM_TASKMON_TASKS
+ *   per ProfHist_e: uint32 count, uint32 max us, uint64 total us, uint32 buckets[PROF_NUM_BUCKETS]
+ *   per TaskMonId_e: uint32 period us, runs, misses, worst overrun us, worst exec us
+ *   course state saves since boot: uint32 requests, writes, skipped, failures, last write us, max write us
+ */
+esp_err_t GET_metrics_handler(httpd_req_t *req)
+{
+    static char resp[METRICS_RESP_SIZE]; // too big for the httpd task stack
+    char* pos = resp;
+
+    *pos++ = NUM_PROF_HISTS;
+    *pos++ = PROF_NUM_BUCKETS;
+    *pos++ = NUM_TASKMON_TASKS;
+
+    for (uint8_t i = 0; i < NUM_PROF_HISTS; i++)
+    {
+        ProfHist_t hist;
+        PROF_get_hist(i, &hist);
+
+        pos = put_u32(pos, hist.count);
+        pos = put_u32(pos, hist.maxUs);
+        pos = put_u32(pos, (uint32_t)hist.totalUs);
+        pos = put_u32(pos, (uint32_t)(hist.totalUs >> 32));
+
+        for (uint8_t b = 0; b < PROF_NUM_BUCKETS; b++)
+        {
+            pos = put_u32(pos, hist.buckets[b]);
+        }
+    }
+
+    for (uint8_t i = 0; i < NUM_TASKMON_TASKS; i++)
+    {
+        TaskMonStats_t stats;
+        TASKMON_get_stats(i, &stats);
+
+        pos = put_u32(pos, stats.periodUs);
+        pos = put_u32(pos, stats.runs);
+        pos = put_u32(pos, stats.misses);
+        pos = put_u32(pos, stats.worstOverrunUs);
+        pos = put_u32(pos, stats.worstExecUs);
+    }
+
+    NVSStats_t nvsStats;
+    NVS_get_stats(&nvsStats);
+
+    pos = put_u32(pos, nvsStats.requests);
+    pos = put_u32(pos, nvsStats.writes);
+    pos = put_u32(pos, nvsStats.skipped);
+    pos = put_u32(pos, nvsStats.failures);
+    pos = put_u32(pos, nvsStats.lastWriteUs);
+    pos = put_u32(pos, nvsStats.maxWriteUs);
+
+    httpd_resp_send(req, resp, sizeof(resp));
+
+    /* After sending the HTTP response the old HTTP request
+     * headers are lost. Check if HTTP request headers can be read now. */
+    if (httpd_req_get_hdr_value_len(req, "Host") == 0) {
+        ESP_LOGD(TAG, "Successfully sent metrics via GET_metrics_handler!");
+    }
+
+    return ESP_OK;
+}
+
+
+/**
+ * Response, all values uint32 little endian unless noted:
+ *   free heap, min free heap, largest free block
+ *   uint8 NUM_MEM_TASKS, uint8 NUM_MEM_MODULES
+ *   per MemTask_e: stack depth, stack high water
+ *   per MemModule_e: heap allocs, heap bytes, static bytes
+ */
+esp_err_t GET_memory_handler(httpd_req_t *req)
+{
+    static MemReport_t report; // too big for the httpd task stack
+    static char resp[MEMORY_RESP_SIZE];
+    char* pos = resp;
+
+    MEM_get_report(&report);
+
+    pos = put_u32(pos, report.freeHeap);
+    pos = put_u32(pos, report.minFreeHeap);
+    pos = put_u32(pos, report.largestFreeBlock);
+    *pos++ = NUM_MEM_TASKS;
+    *pos++ = NUM_MEM_MODULES;
+
+    for (uint8_t i = 0; i < NUM_MEM_TASKS; i++)
+    {
+        pos = put_u32(pos, report.tasks[i].stackDepth);
+        pos = put_u32(pos, report.tasks[i].stackHighWater);
+    }
+
+    for (uint8_t i = 0; i < NUM_MEM_MODULES; i++)
+    {
+        pos = put_u32(pos, report.modules[i].heapAllocs);
+        pos = put_u32(pos, report.modules[i].heapBytes);
+        pos = put_u32(pos, report.modules[i].staticBytes);
+    }
+
+    httpd_resp_send(req, resp, sizeof(resp));
+
+    /* After sending the HTTP response the old HTTP request
+     * headers are lost. Check if HTTP request headers can be read now. */
+    if (httpd_req_get_hdr_value_len(req, "Host") == 0) {
+        ESP_LOGD(TAG, "Successfully sent memory report via GET_memory_handler!");
+    }
+
+    return ESP_OK;
+}
+
+
+/**
+ * Stops the capture, then sends what it recorded. Response, all values little endian:
+ *   uint32 magic "SCP1", uint32 edges that follow, uint32 older edges lost, uint32 capture length us
+ *   uint8 NUM_SENSORS
+ *   per edge, oldest first: uint32 us since the capture started, uint8 SensorId_e | (level << 7)
+ * Sent in chunks, the whole capture doesn't fit in one buffer.
+ */
+esp_err_t GET_sensorCapture_handler(httpd_req_t *req)
+{
+    static char resp[SENSOR_CAPTURE_CHUNK_EDGES * SENSOR_CAPTURE_EDGE_SIZE]; // too big for the httpd task stack
+    char* pos = resp;
+    SnsCaptureInfo_t info;
+
+    // a running capture could overwrite the edges while they are sent
+    SNS_capture_stop();
+    SNS_capture_get_info(&info);
+
+    pos = put_u32(pos, SENSOR_CAPTURE_MAGIC);
+    pos = put_u32(pos, info.numEdges);
+    pos = put_u32(pos, info.lostEdges);
+    pos = put_u32(pos, info.lengthUs);
+    *pos++ = NUM_SENSORS;
+
+    if (httpd_resp_send_chunk(req, resp, SENSOR_CAPTURE_HEADER_SIZE) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to send the sensor capture header in GET_sensorCapture_handler");
+        return ESP_FAIL;
+    }
+
+    for (uint32_t first = 0; first < info.numEdges; first += SENSOR_CAPTURE_CHUNK_EDGES)
+    {
+        SnsCaptureEdge_t edge;
+        pos = resp;
+
+        for (uint32_t i = first; (i < first + SENSOR_CAPTURE_CHUNK_EDGES) && SNS_capture_get_edge(i, &edge); i++)
+        {
+            pos = put_u32(pos, edge.timeUs);
+            *pos++ = edge.sensor | (edge.level << 7);
+        }
+
+        if (httpd_resp_send_chunk(req, resp, pos - resp) != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to send the sensor capture in GET_sensorCapture_handler");
+            return ESP_FAIL;
+        }
+    }
+
+    // an empty chunk ends the response
+    httpd_resp_send_chunk(req, NULL, 0);
+
+    ESP_LOGI(TAG, "Sent a sensor capture of %u edges, %u lost", info.numEdges, info.lostEdges);
+
+    return ESP_OK;
+}
+
+
 // Temp handler for testing purposes
 esp_err_t echo_post_handler(httpd_req_t *req)
 {
-    char buf[1000];
+    static char buf[ECHO_BUF_SIZE]; // off the httpd task stack, the server only runs one handler at a time
     int ret, remaining = req->content_len;
 
     while (remaining > 0) {
@@ -1,11 +1,11 @@
 #include "wifi_init.h"
 #include "wifi_handlers.h"
+#include "boot.h"
 
 #include <string.h>
 #include "esp_wifi.h"
 #include "esp_event.h"
 #include "esp_log.h"
-#include "nvs_flash.h"
 #include "esp_http_server.h"
 
 #include <sys/param.h>
@@ -25,35 +25,93 @@ static const char *TAG="WIFI_INIT.C";
 #define EXAMPLE_ESP_WIFI_PASS      "puttpilot"
 #define EXAMPLE_MAX_STA_CONN       5
 
-httpd_uri_t course_state = {
+#define MAX_URI_HANDLERS           24  // the default of 8 is already used up
+
+static httpd_uri_t course_state = {
     .uri       = "/course_state",
     .method    = HTTP_POST,
     .handler   = POST_courseState_handler,
     .user_ctx  = NULL
 };
 
-httpd_uri_t reset_stats = {
+static httpd_uri_t reset_stats = {
     .uri       = "/reset_stats",
     .method    = HTTP_POST,
     .handler   = POST_resetStats_handler,
     .user_ctx  = NULL
 };
 
-httpd_uri_t settings = {
+static httpd_uri_t settings = {
     .uri       = "/settings",
     .method    = HTTP_POST,
     .handler   = POST_settings_handler,
     .user_ctx  = NULL
 };
 
-httpd_uri_t dispense_ball = {
+static httpd_uri_t dispense_ball = {
     .uri       = "/dispense_ball",
     .method    = HTTP_POST,
     .handler   = POST_dispenseBall_handler,
     .user_ctx  = NULL
 };
 
-httpd_uri_t echo = {
+static httpd_uri_t animation = {
+    .uri       = "/animation",
+    .method    = HTTP_POST,
+    .handler   = POST_animation_handler,
+    .user_ctx  = NULL
+};
+
+static httpd_uri_t timeline = {
+    .uri       = "/timeline",
+    .method    = HTTP_POST,
+    .handler   = POST_timeline_handler,
+    .user_ctx  = NULL
+};
+
+static httpd_uri_t timeline_cmd = {
+    .uri       = "/timeline_cmd",
+    .method    = HTTP_POST,
+    .handler   = POST_timelineCmd_handler,
+    .user_ctx  = NULL
+};
+
+static httpd_uri_t preset_save = {
+    .uri       = "/preset_save",
+    .method    = HTTP_POST,
+    .handler   = POST_presetSave_handler,
+    .user_ctx  = NULL
+};
+
+static httpd_uri_t preset_delete = {
+    .uri       = "/preset_delete",
+    .method    = HTTP_POST,
+    .handler   = POST_presetDelete_handler,
+    .user_ctx  = NULL
+};
+
+static httpd_uri_t preset_recall = {
+    .uri       = "/preset_recall",
+    .method    = HTTP_POST,
+    .handler   = POST_presetRecall_handler,
+    .user_ctx  = NULL
+};
+
+static httpd_uri_t metrics_reset = {
+    .uri       = "/metrics_reset",
+    .method    = HTTP_POST,
+    .handler   = POST_metricsReset_handler,
+    .user_ctx  = NULL
+};
+
+static httpd_uri_t sensor_capture_cmd = {
+    .uri       = "/sensor_capture_cmd",
+    .method    = HTTP_POST,
+    .handler   = POST_sensorCaptureCmd_handler,
+    .user_ctx  = NULL
+};
+
+static httpd_uri_t echo = {
     .uri       = "/echo",
     .method    = HTTP_POST,
     .handler   = echo_post_handler,
@@ -61,27 +119,62 @@ httpd_uri_t echo = {
 };
 
 
-httpd_uri_t error_codes = {
+static httpd_uri_t error_codes = {
     .uri       = "/error_codes",
     .method    = HTTP_GET,
     .handler   = GET_errorCodes_handler,
     .user_ctx  = NULL
 };
 
-httpd_uri_t debug_msg = {
+static httpd_uri_t debug_msg = {
     .uri       = "/debug_msg",
     .method    = HTTP_GET,
     .handler   = GET_debugMsg_handler,
     .user_ctx  = NULL
 };
 
-httpd_uri_t stats = {
+static httpd_uri_t stats = {
     .uri       = "/stats",
     .method    = HTTP_GET,
     .handler   = GET_stats_handler,
     .user_ctx  = NULL
 };
 
+static httpd_uri_t presets = {
+    .uri       = "/presets",
+    .method    = HTTP_GET,
+    .handler   = GET_presets_handler,
+    .user_ctx  = NULL
+};
+
+static httpd_uri_t boot_timeline = {
+    .uri       = "/boot_timeline",
+    .method    = HTTP_GET,
+    .handler   = GET_bootTimeline_handler,
+    .user_ctx  = NULL
+};
+
+static httpd_uri_t metrics = {
+    .uri       = "/metrics",
+    .method    = HTTP_GET,
+    .handler   = GET_metrics_handler,
+    .user_ctx  = NULL
+};
+
+static httpd_uri_t memory = {
+    .uri       = "/memory",
+    .method    = HTTP_GET,
+    .handler   = GET_memory_handler,
+    .user_ctx  = NULL
+};
+
+static httpd_uri_t sensor_capture = {
+    .uri       = "/sensor_capture",
+    .method    = HTTP_GET,
+    .handler   = GET_sensorCapture_handler,
+    .user_ctx  = NULL
+};
+
 static void wifi_event_handler(void* arg, esp_event_base_t event_base,
                                     int32_t event_id, void* event_data)
 {
@@ -100,6 +193,7 @@ httpd_handle_t start_webserver(void)
 {
     httpd_handle_t server = NULL;
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    config.max_uri_handlers = MAX_URI_HANDLERS;
 
     // Start the httpd server
     ESP_LOGI(TAG, "Starting server on port: '%d'", config.server_port);
@@ -110,9 +204,22 @@ httpd_handle_t start_webserver(void)
         httpd_register_uri_handler(server, &reset_stats);
         httpd_register_uri_handler(server, &settings);
         httpd_register_uri_handler(server, &dispense_ball);
+        httpd_register_uri_handler(server, &animation);
+        httpd_register_uri_handler(server, &timeline);
+        httpd_register_uri_handler(server, &timeline_cmd);
+        httpd_register_uri_handler(server, &preset_save);
+        httpd_register_uri_handler(server, &preset_delete);
+        httpd_register_uri_handler(server, &preset_recall);
+        httpd_register_uri_handler(server, &metrics_reset);
+        httpd_register_uri_handler(server, &sensor_capture_cmd);
         httpd_register_uri_handler(server, &error_codes);
         httpd_register_uri_handler(server, &debug_msg);
         httpd_register_uri_handler(server, &stats);
+        httpd_register_uri_handler(server, &presets);
+        httpd_register_uri_handler(server, &boot_timeline);
+        httpd_register_uri_handler(server, &metrics);
+        httpd_register_uri_handler(server, &memory);
+        httpd_register_uri_handler(server, &sensor_capture);
 
         httpd_register_uri_handler(server, &echo);
         return server;
@@ -153,15 +260,16 @@ void wifi_init_softap()
              EXAMPLE_ESP_WIFI_SSID, EXAMPLE_ESP_WIFI_PASS);
 }
 
+// NVS_init must have been called already, WiFi keeps its calibration data in NVS
 void WIFI_init_and_start_server(void)
 {
-    ESP_ERROR_CHECK(nvs_flash_init());
-
     ESP_LOGI(TAG, "ESP_WIFI_MODE_AP");
     wifi_init_softap();
+    BOOT_mark(BOOT_WIFI_AP);
 
     httpd_handle_t server = start_webserver();
     if (server == NULL) {
         ESP_LOGE(TAG, "Failed to start the web server");
     }
+    BOOT_mark(BOOT_HTTPD);
 }
\ No newline at end of file
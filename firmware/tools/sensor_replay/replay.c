@@ -0,0 +1,555 @@
+/**
+ * Replays a sensor capture through the firmware's own sensors.c, ball_estimation.c and ball_queue.c on a host,
+ * under a virtual clock, so debounce and timeout values can be tried against real sessions without reflashing.
+ *
+ * Record on the device: POST /sensor_capture_cmd with 1, play, then GET /sensor_capture into a file (see
+ * sensor_capture_get in wifi_test_script.py). Then:
+ *
+ *   make PARAMS="-DDEBOUNCE_DELAY_MS=10 -DIN_TRANSIT_TIMEOUT_MS=4000"
+ *   build/sensor_replay capture.bin
+ *
+ * The parameters are the #defines of the firmware sources, anything not given keeps the firmware value.
+ * sweep.py runs a whole grid of them.
+ *
+ * Each captured edge goes through the real sensor ISR at its time. The debounce timers, ball estimation and
+ * the 100ms housekeeping pass of the ball queue run at the times they would on the device, higher priority
+ * first, and take no time themselves. The capture starts with ball estimation in READY_TO_HIT.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/timers.h"
+#include "esp_timer.h"
+#include "esp8266/gpio_struct.h"
+
+#include "sensors.h"
+#include "ball_estimation.h"
+#include "ball_queue.h"
+#include "error_codes.h"
+#include "mem_report.h"
+#include "pca9685.h"
+#include "gpio.h"
+
+#ifndef REPLAY_PARAMS
+#define REPLAY_PARAMS           ""
+#endif
+
+#define CAPTURE_MAGIC           0x31504353  // "SCP1"
+#define CAPTURE_HEADER_SIZE     (4 * 4 + 1)
+#define CAPTURE_EDGE_SIZE       (4 + 1)
+#define CAPTURE_LEVEL_SHIFT     7
+
+#define US_PER_MS               1000
+#define US_PER_TICK             (portTICK_PERIOD_MS * US_PER_MS)
+#define HOUSEKEEPING_PERIOD_MS  100     // as in main.c
+
+#define MAX_QUEUES              2
+#define MAX_TIMERS              8
+#define MAX_LOG_MESSAGES        32
+
+// Same order as SensorId_e
+static const gpio_num_t sensorPins[NUM_SENSORS] = { BIH_GPIO_IN, BIG_GPIO_IN, BD_GPIO_IN, BQ_GPIO_IN };
+static const char* sensorNames[NUM_SENSORS] = { "ball in hole", "ball in gutter", "ball departure", "ball queue" };
+static const char* stateNames[] = {
+    [IDLE] = "IDLE", [READY_TO_HIT_on_enter] = "READY_TO_HIT_on_enter", [READY_TO_HIT] = "READY_TO_HIT",
+    [IN_TRANSIT_on_enter] = "IN_TRANSIT_on_enter", [IN_TRANSIT] = "IN_TRANSIT", [IN_HOLE] = "IN_HOLE",
+    [STUCK] = "STUCK", [IN_GUTTER] = "IN_GUTTER", [NO_ESTIMATION_TRACKING] = "NO_ESTIMATION_TRACKING",
+};
+static const char* errorNames[NUM_ERROR_CODES] = { "ball math", "ball in hole feed", "player ball return", "nvs" };
+
+typedef struct {
+    int64_t timeUs;
+    uint8_t sensor;
+    uint8_t level;
+} ReplayEdge_t;
+
+struct ReplayQueue {
+    uint8_t* storage;
+    UBaseType_t itemSize;
+    UBaseType_t length;
+    UBaseType_t head;
+    UBaseType_t count;
+};
+
+struct ReplayTimer {
+    TimerCallbackFunction_t callback;
+    TickType_t period;
+    bool autoReload;
+    bool active;
+    int64_t expiryUs;
+};
+
+typedef struct {
+    const char* format;
+    char level;
+    uint32_t count;
+} LogCount_t;
+
+typedef struct {
+    int64_t nowUs;
+    int64_t endUs;
+    bool finished;
+
+    ReplayEdge_t* edges;
+    uint32_t numEdges;
+    uint32_t nextEdge;
+    uint32_t lostEdges;
+    uint32_t edgesPerSensor[NUM_SENSORS];
+
+    void (*isr)(void*);
+    int64_t nextHousekeepingUs;
+
+    struct ReplayQueue queues[MAX_QUEUES];
+    uint8_t numQueues;
+    struct ReplayTimer timers[MAX_TIMERS];
+    uint8_t numTimers;
+
+    bool quiet;
+    LogCount_t logCounts[MAX_LOG_MESSAGES];
+    uint8_t numLogCounts;
+    uint32_t errorCounts[NUM_ERROR_CODES];
+} Replay_t;
+Replay_t replay = {0};
+
+volatile gpio_dev_t GPIO;
+
+bool load_capture(const char* path);
+void run_next(int64_t deadlineUs, QueueHandle_t queue);
+void apply_edge(const ReplayEdge_t* edge);
+struct ReplayTimer* next_timer(void);
+uint32_t get_u32(const uint8_t* src);
+
+// Little endian
+uint32_t get_u32(const uint8_t* src)
+{
+    return src[0] | (src[1] << 8) | (src[2] << 16) | ((uint32_t)src[3] << 24);
+}
+
+bool load_capture(const char* path)
+{
+    FILE* file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        perror(path);
+        return false;
+    }
+
+    fseek(file, 0, SEEK_END);
+    const long size = ftell(file);
+    rewind(file);
+
+    uint8_t* data = malloc(size > 0 ? size : 1);
+    const bool readOk = (data != NULL) && (fread(data, 1, size, file) == (size_t)size);
+    fclose(file);
+
+    if (!readOk || size < CAPTURE_HEADER_SIZE || get_u32(&data[0]) != CAPTURE_MAGIC)
+    {
+        fprintf(stderr, "%s: not a sensor capture\n", path);
+        free(data);
+        return false;
+    }
+
+    replay.numEdges = get_u32(&data[4]);
+    replay.lostEdges = get_u32(&data[8]);
+    replay.endUs = get_u32(&data[12]);
+
+    if (data[16] != NUM_SENSORS || size != CAPTURE_HEADER_SIZE + ((long)replay.numEdges * CAPTURE_EDGE_SIZE))
+    {
+        fprintf(stderr, "%s: %u sensors and %u edges don't match this firmware or the file size\n",
+                path, data[16], replay.numEdges);
+        free(data);
+        return false;
+    }
+
+    replay.edges = calloc(replay.numEdges + 1, sizeof(ReplayEdge_t));
+
+    // the device keeps 32 bits of us, put back what wrapped
+    int64_t wrapUs = 0;
+    uint32_t prevUs = 0;
+    for (uint32_t i = 0; i < replay.numEdges; i++)
+    {
+        const uint8_t* src = &data[CAPTURE_HEADER_SIZE + (i * CAPTURE_EDGE_SIZE)];
+        const uint32_t timeUs = get_u32(src);
+
+        if (timeUs < prevUs)
+        {
+            wrapUs += (int64_t)1 << 32;
+        }
+        prevUs = timeUs;
+
+        replay.edges[i].timeUs = wrapUs + timeUs;
+        replay.edges[i].sensor = src[4] & ~(1 << CAPTURE_LEVEL_SHIFT);
+        replay.edges[i].level = src[4] >> CAPTURE_LEVEL_SHIFT;
+
+        if (replay.edges[i].sensor >= NUM_SENSORS)
+        {
+            fprintf(stderr, "%s: edge %u is from unknown sensor %u\n", path, i, replay.edges[i].sensor);
+            free(data);
+            return false;
+        }
+        replay.edgesPerSensor[replay.edges[i].sensor]++;
+    }
+
+    // the capture length wraps too
+    if (replay.numEdges > 0)
+    {
+        while (replay.endUs < replay.edges[replay.numEdges - 1].timeUs)
+        {
+            replay.endUs += (int64_t)1 << 32;
+        }
+    }
+
+    free(data);
+    return true;
+}
+
+// Sets the pin like the edge did and raises its interrupt
+void apply_edge(const ReplayEdge_t* edge)
+{
+    const uint32_t pinMask = 1 << sensorPins[edge->sensor];
+
+    GPIO.in.val = edge->level ? (GPIO.in.val | pinMask) : (GPIO.in.val & ~pinMask);
+    GPIO.status.val = pinMask;
+
+    if (replay.isr != NULL)
+    {
+        replay.isr(NULL);
+    }
+}
+
+struct ReplayTimer* next_timer(void)
+{
+    struct ReplayTimer* next = NULL;
+
+    for (uint8_t i = 0; i < replay.numTimers; i++)
+    {
+        if (replay.timers[i].active && (next == NULL || replay.timers[i].expiryUs < next->expiryUs))
+        {
+            next = &replay.timers[i];
+        }
+    }
+
+    return next;
+}
+
+/**
+ * Runs the capture forward until deadlineUs, or until something is put in queue. Edges come first, then the
+ * timers, then housekeeping, which is the order their priorities run them in on the device.
+ */
+void run_next(int64_t deadlineUs, QueueHandle_t queue)
+{
+    while (!replay.finished && (queue == NULL || queue->count == 0))
+    {
+        const ReplayEdge_t* edge = (replay.nextEdge < replay.numEdges) ? &replay.edges[replay.nextEdge] : NULL;
+        struct ReplayTimer* timer = next_timer();
+
+        int64_t nextUs = replay.nextHousekeepingUs;
+        if (timer != NULL && timer->expiryUs <= nextUs)
+        {
+            nextUs = timer->expiryUs;
+        }
+        else
+        {
+            timer = NULL;
+        }
+        if (edge != NULL && edge->timeUs <= nextUs)
+        {
+            nextUs = edge->timeUs;
+            timer = NULL;
+        }
+        else
+        {
+            edge = NULL;
+        }
+
+        // whoever waits wakes up before anything else due at the same time
+        if (deadlineUs <= nextUs && deadlineUs <= replay.endUs)
+        {
+            replay.nowUs = (deadlineUs > replay.nowUs) ? deadlineUs : replay.nowUs;
+            return;
+        }
+
+        if (nextUs > replay.endUs)
+        {
+            replay.nowUs = replay.endUs;
+            replay.finished = true;
+            return;
+        }
+
+        replay.nowUs = nextUs;
+
+        if (edge != NULL)
+        {
+            apply_edge(edge);
+            replay.nextEdge++;
+        }
+        else if (timer != NULL)
+        {
+            timer->active = timer->autoReload;
+            timer->expiryUs += (int64_t)timer->period * US_PER_TICK;
+            timer->callback(timer);
+        }
+        else
+        {
+            BQ_run_task();
+            replay.nextHousekeepingUs += HOUSEKEEPING_PERIOD_MS * US_PER_MS;
+        }
+    }
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return replay.nowUs;
+}
+
+QueueHandle_t xQueueCreateStatic(UBaseType_t length, UBaseType_t itemSize, uint8_t* storage, StaticQueue_t* buffer)
+{
+    if (replay.numQueues == MAX_QUEUES)
+    {
+        return NULL;
+    }
+
+    struct ReplayQueue* queue = &replay.queues[replay.numQueues++];
+    queue->storage = storage;
+    queue->itemSize = itemSize;
+    queue->length = length;
+    queue->head = 0;
+    queue->count = 0;
+
+    return queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t ticksToWait)
+{
+    if (queue->count == queue->length)
+    {
+        return pdFALSE;
+    }
+
+    const UBaseType_t slot = (queue->head + queue->count) % queue->length;
+    memcpy(&queue->storage[slot * queue->itemSize], item, queue->itemSize);
+    queue->count++;
+
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t ticksToWait)
+{
+    if (queue->count == 0 && ticksToWait > 0)
+    {
+        // a wait starts on the current tick, like on the device
+        const int64_t deadlineUs = (ticksToWait == portMAX_DELAY) ? INT64_MAX
+                                 : ((replay.nowUs / US_PER_TICK) + ticksToWait) * US_PER_TICK;
+        run_next(deadlineUs, queue);
+    }
+
+    if (queue->count == 0)
+    {
+        return pdFALSE;
+    }
+
+    memcpy(item, &queue->storage[queue->head * queue->itemSize], queue->itemSize);
+    queue->head = (queue->head + 1) % queue->length;
+    queue->count--;
+
+    return pdTRUE;
+}
+
+TimerHandle_t xTimerCreateStatic(const char* name, TickType_t period, UBaseType_t autoReload, void* id,
+                                 TimerCallbackFunction_t callback, StaticTimer_t* buffer)
+{
+    if (replay.numTimers == MAX_TIMERS)
+    {
+        return NULL;
+    }
+
+    struct ReplayTimer* timer = &replay.timers[replay.numTimers++];
+    timer->callback = callback;
+    timer->period = period;
+    timer->autoReload = autoReload;
+    timer->active = false;
+
+    return timer;
+}
+
+BaseType_t xTimerResetFromISR(TimerHandle_t timer, BaseType_t* higherPriorityTaskWoken)
+{
+    // counts from the tick the reset came in on, like on the device
+    timer->expiryUs = ((replay.nowUs / US_PER_TICK) + timer->period) * US_PER_TICK;
+    timer->active = true;
+
+    return pdPASS;
+}
+
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level)
+{
+    return ESP_OK;
+}
+
+esp_err_t gpio_isr_register(void (*fn)(void*), void* arg, int no_use, gpio_isr_handle_t* handle_no_use)
+{
+    replay.isr = fn;
+    return ESP_OK;
+}
+
+void MEM_count_static(MemModule_e module, size_t bytes)
+{
+}
+
+// The dispenser servos are not simulated, the ball queue sensor in the capture says when balls came out
+void PCA9685_initHandle(PCA9685_t* pca9685)
+{
+}
+
+void PCA9685_setServoPos(const PCA9685_t* pca9685, uint8_t outputPin, uint8_t servoPos)
+{
+}
+
+void ERRORCODE_set(ERROR_CODE_e error)
+{
+    replay.errorCounts[error]++;
+}
+
+void replay_log(char level, const char* tag, const char* format, ...)
+{
+    uint8_t i;
+    for (i = 0; i < replay.numLogCounts; i++)
+    {
+        if (strcmp(replay.logCounts[i].format, format) == 0)
+        {
+            break;
+        }
+    }
+
+    if (i < MAX_LOG_MESSAGES)
+    {
+        if (i == replay.numLogCounts)
+        {
+            replay.logCounts[i].format = format;
+            replay.logCounts[i].level = level;
+            replay.numLogCounts++;
+        }
+        replay.logCounts[i].count++;
+    }
+
+    if (replay.quiet)
+    {
+        return;
+    }
+
+    va_list args;
+    va_start(args, format);
+    printf("[%10.3f] %c %s: ", replay.nowUs / (double)(US_PER_MS * 1000), level, tag);
+    vprintf(format, args);
+    printf("\n");
+    va_end(args);
+}
+
+int main(int argc, char** argv)
+{
+    bool autoDispense = true;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "mq")) != -1)
+    {
+        switch (opt)
+        {
+            case 'm':
+                autoDispense = false;
+                break;
+            case 'q':
+                replay.quiet = true;
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-m] [-q] capture.bin\n"
+                                "  -m  auto dispense off, ball estimation only counts\n"
+                                "  -q  summary only, no log\n", argv[0]);
+                return 2;
+        }
+    }
+
+    if (optind >= argc || !load_capture(argv[optind]))
+    {
+        return 1;
+    }
+
+    BQ_init();
+    SNS_init();
+    BE_set_auto_dispense(autoDispense);
+
+    // ball estimation is the waiting task, the capture runs forward from inside its waits
+    BallEstState_e prevState = BE_get_state();
+    int64_t departureUs = -1;
+    uint32_t turnarounds = 0;
+    int64_t turnaroundTotalUs = 0;
+    int64_t turnaroundMaxUs = 0;
+
+    while (!replay.finished)
+    {
+        BE_run_task();
+
+        const BallEstState_e state = BE_get_state();
+        if (state == prevState)
+        {
+            continue;
+        }
+
+        if (!replay.quiet)
+        {
+            printf("[%10.3f] state %s\n", replay.nowUs / (double)(US_PER_MS * 1000), stateNames[state]);
+        }
+
+        if (state == IN_TRANSIT)
+        {
+            departureUs = replay.nowUs;
+        }
+        else if (state == READY_TO_HIT && departureUs >= 0)
+        {
+            const int64_t turnaroundUs = replay.nowUs - departureUs;
+
+            turnarounds++;
+            turnaroundTotalUs += turnaroundUs;
+            turnaroundMaxUs = (turnaroundUs > turnaroundMaxUs) ? turnaroundUs : turnaroundMaxUs;
+            departureUs = -1;
+        }
+
+        prevState = state;
+    }
+
+    printf("params: %s\n", REPLAY_PARAMS);
+    printf("capture_s: %.3f\n", replay.endUs / (double)(US_PER_MS * 1000));
+    printf("edges: %u\n", replay.numEdges);
+    printf("edges_lost: %u\n", replay.lostEdges);
+    for (uint8_t i = 0; i < NUM_SENSORS; i++)
+    {
+        printf("edges %s: %u\n", sensorNames[i], replay.edgesPerSensor[i]);
+    }
+
+    printf("balls_hit: %u\n", BE_get_balls_hit());
+    printf("balls_in_hole: %u\n", BE_get_balls_in_hole());
+    printf("final_state: %s\n", stateNames[BE_get_state()]);
+
+    // departure to ready to hit again, how long the course keeps the player waiting
+    printf("turnarounds: %u\n", turnarounds);
+    printf("turnaround_mean_ms: %.1f\n", turnarounds ? (turnaroundTotalUs / (double)turnarounds) / US_PER_MS : 0.0);
+    printf("turnaround_max_ms: %.1f\n", turnaroundMaxUs / (double)US_PER_MS);
+
+    for (uint8_t i = 0; i < NUM_ERROR_CODES; i++)
+    {
+        printf("errors %s: %u\n", errorNames[i], replay.errorCounts[i]);
+    }
+
+    for (uint8_t i = 0; i < replay.numLogCounts; i++)
+    {
+        printf("log %c %ux: %s\n", replay.logCounts[i].level, replay.logCounts[i].count, replay.logCounts[i].format);
+    }
+
+    free(replay.edges);
+    return 0;
+}
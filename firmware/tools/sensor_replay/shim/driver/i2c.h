@@ -0,0 +1,9 @@
+#ifndef REPLAY_DRIVER_I2C_H
+#define REPLAY_DRIVER_I2C_H
+
+// Only the types i2c.h needs, nothing on the bus is replayed
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef REPLAY_GPIO_STRUCT_H
+#define REPLAY_GPIO_STRUCT_H
+
+#include <stdint.h>
+
+// The registers the sensor ISR reads, replay.c sets them before calling it
+typedef struct {
+    uint32_t val;
+} ReplayGpioReg_t;
+
+typedef struct {
+    ReplayGpioReg_t in;
+    ReplayGpioReg_t status;
+    ReplayGpioReg_t status_w1tc;
+} gpio_dev_t;
+
+extern volatile gpio_dev_t GPIO;
+
+#endif
@@ -0,0 +1,6 @@
+#ifndef REPLAY_ESP_ATTR_H
+#define REPLAY_ESP_ATTR_H
+
+#define IRAM_ATTR
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef REPLAY_ESP_LOG_H
+#define REPLAY_ESP_LOG_H
+
+// Printed with the virtual time and counted for the summary, debug and verbose are dropped
+void replay_log(char level, const char* tag, const char* format, ...) __attribute__((format(printf, 3, 4)));
+
+#define ESP_LOGE(tag, format, ...)  replay_log('E', tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...)  replay_log('W', tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...)  replay_log('I', tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...)
+#define ESP_LOGV(tag, format, ...)
+
+#endif
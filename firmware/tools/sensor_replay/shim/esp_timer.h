@@ -0,0 +1,9 @@
+#ifndef REPLAY_ESP_TIMER_H
+#define REPLAY_ESP_TIMER_H
+
+#include <stdint.h>
+
+// The virtual clock, in us since the capture started
+int64_t esp_timer_get_time(void);
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef REPLAY_FREERTOS_H
+#define REPLAY_FREERTOS_H
+
+/**
+ * Just enough of FreeRTOS for the sensor and ball logic to build on a host. Everything runs on one thread
+ * under the virtual clock of replay.c, which also implements the queues and timers.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+typedef uint32_t TickType_t;
+typedef int32_t BaseType_t;
+typedef uint32_t UBaseType_t;
+typedef uint32_t StackType_t;
+
+#define portMAX_DELAY           ((TickType_t)0xFFFFFFFF)
+#define portTICK_PERIOD_MS      1       // CONFIG_FREERTOS_HZ=1000, as on the device
+#define pdMS_TO_TICKS(ms)       ((TickType_t)(ms) / portTICK_PERIOD_MS)
+
+#define pdTRUE                  1
+#define pdFALSE                 0
+#define pdPASS                  pdTRUE
+#define pdFAIL                  pdFALSE
+
+// one thread, nothing can preempt
+#define taskENTER_CRITICAL()
+#define taskEXIT_CRITICAL()
+#define portYIELD_FROM_ISR()
+
+typedef struct { uint8_t unused; } StaticTask_t;
+typedef struct { uint8_t unused; } StaticQueue_t;
+typedef struct { uint8_t unused; } StaticTimer_t;
+
+#endif
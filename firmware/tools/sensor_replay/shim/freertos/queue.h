@@ -0,0 +1,16 @@
+#ifndef REPLAY_QUEUE_H
+#define REPLAY_QUEUE_H
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct ReplayQueue* QueueHandle_t;
+
+QueueHandle_t xQueueCreateStatic(UBaseType_t length, UBaseType_t itemSize, uint8_t* storage, StaticQueue_t* buffer);
+
+// Never blocks, there is nobody else to make room
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t ticksToWait);
+
+// Blocking runs the capture forward until an item comes in or the wait times out
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t ticksToWait);
+
+#endif
@@ -0,0 +1,9 @@
+#ifndef REPLAY_TASK_H
+#define REPLAY_TASK_H
+
+#include "freertos/FreeRTOS.h"
+
+typedef void* TaskHandle_t;
+typedef void (*TaskFunction_t)(void* arg);
+
+#endif
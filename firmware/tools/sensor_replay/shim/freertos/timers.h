@@ -0,0 +1,13 @@
+#ifndef REPLAY_TIMERS_H
+#define REPLAY_TIMERS_H
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct ReplayTimer* TimerHandle_t;
+typedef void (*TimerCallbackFunction_t)(TimerHandle_t timer);
+
+TimerHandle_t xTimerCreateStatic(const char* name, TickType_t period, UBaseType_t autoReload, void* id,
+                                 TimerCallbackFunction_t callback, StaticTimer_t* buffer);
+BaseType_t xTimerResetFromISR(TimerHandle_t timer, BaseType_t* higherPriorityTaskWoken);
+
+#endif
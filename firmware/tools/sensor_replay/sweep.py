@@ -0,0 +1,52 @@
+"""
+Replays a sensor capture for every combination of firmware parameters and lists them by mean turnaround.
+
+    python3 sweep.py capture.bin DEBOUNCE_DELAY_MS=5,10,15 IN_TRANSIT_TIMEOUT_MS=3000,4000,5000
+"""
+
+import itertools
+import subprocess
+import sys
+from pathlib import Path
+
+REPLAY_DIR = Path(__file__).resolve().parent
+
+def replay(capture, params):
+    """Builds the replay with the given #define values and returns its summary as a dict."""
+    defines = " ".join(f"-D{name}={value}" for name, value in params)
+    subprocess.run(["make", "-s", "-C", str(REPLAY_DIR), f"PARAMS={defines}"], check=True)
+    output = subprocess.run([str(REPLAY_DIR / "build" / "sensor_replay"), "-q", capture],
+                            check=True, capture_output=True, text=True).stdout
+
+    summary = {}
+    for line in output.splitlines():
+        key, _, value = line.partition(": ")
+        summary[key] = value
+    return summary
+
+def main():
+    if len(sys.argv) < 3:
+        print(__doc__)
+        sys.exit(2)
+
+    capture = sys.argv[1]
+    grid = []
+    for arg in sys.argv[2:]:
+        name, _, values = arg.partition("=")
+        grid.append([(name, value) for value in values.split(",")])
+
+    results = []
+    for params in itertools.product(*grid):
+        summary = replay(capture, params)
+        results.append((float(summary["turnaround_mean_ms"]), params, summary))
+
+    for mean, params, summary in sorted(results, key=lambda result: result[0]):
+        errors = sum(int(value) for key, value in summary.items() if key.startswith("errors "))
+        # log lines are "log <level> <count>x: <message>"
+        stuck = sum(int(key.split()[2].rstrip("x")) for key, value in summary.items() if key.startswith("log ") and "stuck" in value)
+        settings = " ".join(f"{name}={value}" for name, value in params)
+        print(f"{settings}: mean {mean:.1f} ms, max {summary['turnaround_max_ms']} ms, "
+              f"hit {summary['balls_hit']}, in hole {summary['balls_in_hole']}, stuck {stuck}, errors {errors}")
+
+if __name__ == "__main__":
+    main()
@@ -1,4 +1,5 @@
 import requests
+import struct
 import time
 
 # Define the base URL of the server
@@ -6,7 +7,7 @@ BASE_URL = "http://192.168.4.1"
 
 def course_state_post():
     """Function to perform a POST request to /course_state."""
-    integers = [1] + [90 for x in range(15)] + [90 for x in range(15)] + [90 for x in range(15)]
+    integers = [0] + [90 for x in range(15)] + [90 for x in range(15)] + [90 for x in range(15)]
     string = ''.join(chr(value) for value in integers)
     print(integers)
     response = requests.post(f"{BASE_URL}/course_state", data=string)
@@ -42,6 +43,62 @@ def dispense_ball_post():
     print("Response Body:", response.text)  
 
 
+def animation_post():
+    """Function to perform a POST request to /animation."""
+    # mode (2 = wave, 3 = tsunami), amplitude, center, wavelength, speed, direction
+    integers = [2, 30, 45, 6, 30, 64]
+    string = ''.join(chr(value) for value in integers)
+    response = requests.post(f"{BASE_URL}/animation", data=string)
+    print("POST /animation response:")
+    print("Status Code:", response.status_code)
+    print("Response Body:", response.text)
+
+def timeline_post():
+    """Function to perform a POST request to /timeline, a slow sweep of the whole course up and down."""
+    # keyframes of (duration ms, easing, positions), easing 3 = ease in-out
+    keyframes = [(2000, 3, [0] * 45), (2000, 3, [90] * 45), (2000, 3, [0] * 45)]
+
+    segments = b''.join(struct.pack("<HB", duration, easing) + bytes(positions) for duration, easing, positions in keyframes)
+
+    checksum = 0x811C9DC5
+    for byte in segments:
+        checksum = ((checksum ^ byte) * 0x01000193) & 0xFFFFFFFF
+
+    data = struct.pack("<IHHI", 0x314C5450, len(keyframes), 0, checksum) + segments
+    response = requests.post(f"{BASE_URL}/timeline", data=data)
+    print("POST /timeline response:")
+    print("Status Code:", response.status_code)
+    print("Response Body:", response.text)
+
+def timeline_cmd_post(command):
+    """Function to perform a POST request to /timeline_cmd (0 = stop, 1 = one shot, 2 = loop, 3 = ping-pong)."""
+    response = requests.post(f"{BASE_URL}/timeline_cmd", data=bytes([command]))
+    print("POST /timeline_cmd response:")
+    print("Status Code:", response.status_code)
+    print("Response Body:", response.text)
+
+def preset_save_post(preset_id, name, positions):
+    """Function to perform a POST request to /preset_save."""
+    data = bytes([preset_id]) + name.encode()[:16].ljust(16, b'\0') + bytes(positions)
+    response = requests.post(f"{BASE_URL}/preset_save", data=data)
+    print("POST /preset_save response:")
+    print("Status Code:", response.status_code)
+    print("Response Body:", response.text)
+
+def preset_delete_post(preset_id):
+    """Function to perform a POST request to /preset_delete."""
+    response = requests.post(f"{BASE_URL}/preset_delete", data=bytes([preset_id]))
+    print("POST /preset_delete response:")
+    print("Status Code:", response.status_code)
+    print("Response Body:", response.text)
+
+def preset_recall_post(preset_id):
+    """Function to perform a POST request to /preset_recall."""
+    response = requests.post(f"{BASE_URL}/preset_recall", data=bytes([preset_id]))
+    print("POST /preset_recall response:")
+    print("Status Code:", response.status_code)
+    print("Response Body:", response.text)
+
 
 def error_codes_get():
     """Function to perform a GET request to /error_codes and print all elements."""
@@ -72,6 +129,111 @@ def stats_get():
     print("Status Code:", response.status_code)
     print(f"Balls hit: {ord(response.text[0])}, Balls in hole: {ord(response.text[1])}")
 
+def presets_get():
+    """Function to perform a GET request to /presets and print the used slots."""
+    response = requests.get(f"{BASE_URL}/presets")
+    print("GET /presets response:")
+    print("Status Code:", response.status_code)
+
+    for preset_id in range(len(response.content) // 17):
+        entry = response.content[preset_id * 17:(preset_id + 1) * 17]
+        if entry[0]:
+            name = entry[1:].rstrip(b'\0').decode(errors='replace')
+            print(f"Preset {preset_id}: {name}")
+
+def boot_timeline_get():
+    """Function to perform a GET request to /boot_timeline, the time each boot phase finished at."""
+    phases = ["app_main", "i2c", "nvs", "pwm", "timeline", "gpio", "adc", "ball queue", "sensors", "tasks", "wifi ap", "httpd"]
+    response = requests.get(f"{BASE_URL}/boot_timeline")
+    print("GET /boot_timeline response:")
+    print("Status Code:", response.status_code)
+
+    timestamps = struct.unpack(f"<{len(response.content) // 4}I", response.content)
+    for phase, timestamp in zip(phases, timestamps):
+        print(f"{phase:>10}: {timestamp / 1000:8.1f} ms")
+
+def metrics_get():
+    """Function to perform a GET request to /metrics, run time and jitter histograms, task deadlines and NVS saves."""
+    hists = ["exec sns", "exec adc", "exec tl", "exec ac", "exec be", "exec bq", "exec nvs",
+             "sns confirm delay", "jitter act ctrl", "jitter housekeeping"]
+    tasks = ["act ctrl", "housekeeping"]
+    response = requests.get(f"{BASE_URL}/metrics")
+    print("GET /metrics response:")
+    print("Status Code:", response.status_code)
+
+    data = response.content
+    num_hists, num_buckets, num_tasks = data[0], data[1], data[2]
+    pos = 3
+    for i in range(num_hists):
+        count, max_us, total_us = struct.unpack_from("<IIQ", data, pos)
+        buckets = struct.unpack_from(f"<{num_buckets}I", data, pos + 16)
+        pos += 16 + 4 * num_buckets
+        mean_us = total_us / count if count else 0
+        print(f"{hists[i] if i < len(hists) else i:>20}: n={count} mean={mean_us:.1f}us max={max_us}us buckets={list(buckets)}")
+
+    for i in range(num_tasks):
+        period_us, runs, misses, worst_overrun_us, worst_exec_us = struct.unpack_from("<5I", data, pos)
+        pos += 20
+        print(f"{tasks[i] if i < len(tasks) else i:>20}: period={period_us}us runs={runs} misses={misses} "
+              f"worst overrun={worst_overrun_us}us worst exec={worst_exec_us}us")
+
+    save_requests, writes, skipped, failures, last_write_us, max_write_us = struct.unpack_from("<6I", data, pos)
+    print(f"{'nvs course state':>20}: requests={save_requests} writes={writes} skipped={skipped} failures={failures} "
+          f"last write={last_write_us}us max write={max_write_us}us")
+
+def metrics_reset_post():
+    """Function to perform a POST request to /metrics_reset."""
+    response = requests.post(f"{BASE_URL}/metrics_reset")
+    print("POST /metrics_reset response:")
+    print("Status Code:", response.status_code)
+    print("Response Body:", response.text)
+
+def memory_get():
+    """Function to perform a GET request to /memory, heap and stack usage."""
+    tasks = ["task_ball_est", "task_act_ctrl", "task_act_out", "task_100ms"]
+    modules = ["i2c", "actuator output", "sensors", "tasks"]
+    response = requests.get(f"{BASE_URL}/memory")
+    print("GET /memory response:")
+    print("Status Code:", response.status_code)
+
+    data = response.content
+    free_heap, min_free_heap, largest_block = struct.unpack_from("<3I", data, 0)
+    num_tasks, num_modules = data[12], data[13]
+    print(f"Free heap {free_heap}, min free heap {min_free_heap}, largest free block {largest_block}")
+
+    pos = 14
+    for i in range(num_tasks):
+        depth, high_water = struct.unpack_from("<2I", data, pos)
+        pos += 8
+        print(f"{tasks[i] if i < len(tasks) else i:>16}: stack {depth}, never less than {high_water} free")
+
+    for i in range(num_modules):
+        allocs, heap_bytes, static_bytes = struct.unpack_from("<3I", data, pos)
+        pos += 12
+        print(f"{modules[i] if i < len(modules) else i:>16}: {allocs} heap allocs ({heap_bytes} bytes), {static_bytes} bytes static")
+
+def sensor_capture_cmd_post(start):
+    """Function to perform a POST request to /sensor_capture_cmd (1 = start a new capture, 0 = stop)."""
+    response = requests.post(f"{BASE_URL}/sensor_capture_cmd", data=bytes([1 if start else 0]))
+    print("POST /sensor_capture_cmd response:")
+    print("Status Code:", response.status_code)
+    print("Response Body:", response.text)
+
+def sensor_capture_get(path="capture.bin"):
+    """Function to perform a GET request to /sensor_capture and save it for tools/sensor_replay."""
+    response = requests.get(f"{BASE_URL}/sensor_capture")
+    print("GET /sensor_capture response:")
+    print("Status Code:", response.status_code)
+
+    magic, num_edges, lost_edges, length_us = struct.unpack_from("<4I", response.content, 0)
+    if magic != 0x31504353:
+        print("Error: not a sensor capture")
+        return
+
+    with open(path, "wb") as file:
+        file.write(response.content)
+    print(f"Saved {num_edges} edges over {length_us / 1e6:.1f} s to {path} ({lost_edges} older edges lost)")
+
 if __name__ == "__main__":
     # error_codes_get()
     # print()